@@ -86,8 +86,6 @@
 
 */
 
-#undef WR2DEBUG
-
 #if ARDUINO >= 100
 #include "Arduino.h"
 #else
@@ -97,29 +95,120 @@
 
 #include "SDL_ESP32_WeatherRack2.h"
 
+#if defined(WEATHERRACK2_HEAP_STATS) && defined(ESP32)
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#endif
+
+#ifdef WEATHERRACK2_TRACE
+
+#define WR2_TRACE(type, a, b) trace(type, a, b)
+
+// Trace ring, written from inside the bit loop so it has to be cheap: 8 bytes and a cycle count.
+// See dumpTrace() and extras/wr2trace
+
+struct TraceEvent {
+  uint32_t cycles;
+  uint8_t type;
+  uint8_t a;
+  uint16_t b;
+};
+
+TraceEvent traceRing[WEATHERRACK2_TRACE_SIZE];
+uint16_t traceNext = 0;
+boolean traceWrapped = false;
+
+inline void trace(uint8_t type, uint8_t a, uint16_t b)
+{
+  TraceEvent &event = traceRing[traceNext];
+
+#ifdef ESP32
+  event.cycles = ESP.getCycleCount();
+#else
+  event.cycles = micros();
+#endif
+  event.type = type;
+  event.a = a;
+  event.b = b;
+
+  traceNext++;
+  if (traceNext == WEATHERRACK2_TRACE_SIZE)
+  {
+    traceNext = 0;
+    traceWrapped = true;
+  }
+}
+
+#else
+#define WR2_TRACE(type, a, b) do {} while (0)
+#endif
+
+#define ERROR_JSON "{\"Type\" : \"None\"}"
+#define TIMEOUT_JSON "{\"Type\" : \"TimeOut\"}"
+
 // pins
 int RxPin           = RX_IN_PIN;   //The number of signal from the Rx
 
-#ifdef WR2DEBUG
-int PinTest = 15;
-int pinValue  = 0;
-int PinTestF0300 = 27;
-int pinValueF0300  = 0;
+#ifdef WEATHERRACK2_OVERSAMPLE
+
+// Samples of RxPin, 32 to a word with the oldest in bit 0.  Written by sampleISR() or feedSamples()
+// and decoded by decodeSamples() whenever poll() gets round to it
+volatile uint32_t sampleRing[WEATHERRACK2_SAMPLE_WORDS];
+volatile uint32_t samplesWritten = 0;
+uint32_t samplePosition = 0;    // next sample to decode, once locked the one before the last mid bit transition
+boolean sampleLocked = false;   // bit boundaries found, decoding a header or frame
+long sampleOverruns = 0;
+int samplePhase = 0;            // last mid bit transition after samplePosition, in sixteenths of a sample
+int samplePeriod = 128;         // bit period in sixteenths of a sample, nominally 8 samples
+
+#ifdef ESP32
+hw_timer_t *sampleTimer = NULL;
 
-int messageFoundPin = 14;
-int PinHeaderTest = 33;
-int pinHeaderValue = 0;
-int PinHeaderBitTest = 12;
-int pinHeaderBitValue = 0;
+void IRAM_ATTR sampleISR()
+{
+  uint32_t n = samplesWritten;
+  uint32_t sample = (uint32_t)digitalRead(RxPin) << (n & 31);
+  volatile uint32_t &samples = sampleRing[(n >> 5) % WEATHERRACK2_SAMPLE_WORDS];
+
+  samples = ((n & 31) == 0) ? sample : (samples | sample);
+  samplesWritten = n + 1;
+}
 #endif
 
+// The 32 samples from position on, which need not be word aligned
+
+inline uint32_t samplesAt(uint32_t position)
+{
+  uint32_t index = position >> 5;
+  uint8_t shift = position & 31;
+  uint32_t samples = sampleRing[index % WEATHERRACK2_SAMPLE_WORDS] >> shift;
+
+  if (shift != 0)
+    samples |= sampleRing[(index + 1) % WEATHERRACK2_SAMPLE_WORDS] << (32 - shift);
+  return samples;
+}
+
+#endif
+
+
 // Class Functions
 
 SDL_ESP32_WeatherRack2::SDL_ESP32_WeatherRack2(long timeout, boolean read_weatherrack2 , boolean read_indoorth   )
 {
   _timeout = timeout;
+  _deadline = WEATHERRACK2_DEADLINE;
+  _bitTimeout = WEATHERRACK2_BIT_TIMEOUT;
+  _yieldInterval = WEATHERRACK2_YIELD_INTERVAL;
+  _autoLearn = false;
+  allowedCount = 0;
   _read_weatherrack2 = read_weatherrack2;
   _read_indoorth = read_indoorth;
+
+  for (int i = 0; i < WEATHERRACK2_MAX_SUBSCRIPTIONS; i++)
+  {
+    subscriptions[i].callback = NULL;
+  }
 }
 
 void SDL_ESP32_WeatherRack2::begin()
@@ -128,24 +217,50 @@ void SDL_ESP32_WeatherRack2::begin()
   headersFound = 0;
   FT300MessagesFound = 0;
   FT007MessagesFound = 0;
-  ErrorJSON = "{\"Type\" : \"None\"}";
-  TimeOutJSON = "{\"Type\" : \"TimeOut\"}";
-
-  currentJSON = ErrorJSON;
+  strcpy(currentJSON, ERROR_JSON);
   messageID = 0;
 
+  worstCaseMicros = 0;
+
+  heapAllocationsLastMessage = 0;
+  heapAllocationsMax = 0;
+
+  framesRejected = 0;
+  lastFrameLength = 0;
+
+  for (int i = 0; i < WEATHERRACK2_LINK_TABLE_SIZE; i++)
+  {
+    linkTable[i].framesGood = 0;
+    linkTable[i].framesBad = 0;
+  }
+
+  queueHead = 0;
+  queueCount = 0;
+  queueDropped = 0;
+
   pinMode(RxPin, INPUT);
-#ifdef WR2DEBUG
-  pinMode(PinTest, OUTPUT);
-  pinMode(PinHeaderTest, OUTPUT);
-  pinMode(PinHeaderBitTest, OUTPUT);
-  pinMode(PinTestF0300, OUTPUT);
-  pinMode(messageFoundPin, OUTPUT);
-  digitalWrite(PinTest, LOW);
-  digitalWrite(PinTestF0300, LOW);
-  digitalWrite(messageFoundPin, LOW);
-  digitalWrite(PinHeaderTest, LOW);
-  digitalWrite(PinHeaderBitTest, LOW);
+
+#ifdef WEATHERRACK2_OVERSAMPLE
+  samplePosition = samplesWritten;
+  sampleLocked = false;
+  sampleOverruns = 0;
+
+#ifdef ESP32
+  if (sampleTimer == NULL)
+  {
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && (ESP_ARDUINO_VERSION_MAJOR >= 3)
+    // 3.x cores take the timer frequency and pick a free timer themselves
+    sampleTimer = timerBegin(1000000);   // 1 MHz
+    timerAttachInterrupt(sampleTimer, &sampleISR);
+    timerAlarm(sampleTimer, WEATHERRACK2_SAMPLE_PERIOD, true, 0);
+#else
+    sampleTimer = timerBegin(WEATHERRACK2_SAMPLE_TIMER, 80, true);   // 1 MHz
+    timerAttachInterrupt(sampleTimer, &sampleISR, true);
+    timerAlarmWrite(sampleTimer, WEATHERRACK2_SAMPLE_PERIOD, true);
+    timerAlarmEnable(sampleTimer);
+#endif
+  }
+#endif
 #endif
 
   eraseManchester();  //clear the array to different nos cause if all zeroes it might think that is a valid 3 packets ie all equal
@@ -153,18 +268,296 @@ void SDL_ESP32_WeatherRack2::begin()
 }
 
 
-String SDL_ESP32_WeatherRack2::getCurrentJSON()
+#ifdef WEATHERRACK2_NO_STRING
+
+const char *SDL_ESP32_WeatherRack2::getCurrentJSON()
 {
   return currentJSON;
 }
 
+const char *SDL_ESP32_WeatherRack2::waitForNextJSON()
+{
+  startCall(_timeout * 1000UL);
+  returnMessageJSON();
+  endCall();
+
+  return currentJSON;
+}
+
+#else
+
+String SDL_ESP32_WeatherRack2::getCurrentJSON()
+{
+  return String(currentJSON);
+}
+
 String SDL_ESP32_WeatherRack2::waitForNextJSON()
 {
+  startCall(_timeout * 1000UL);
+  returnMessageJSON();
+  endCall();
+
+  return String(currentJSON);
+}
+
+String SDL_ESP32_WeatherRack2::toJSON(const WeatherRack2Reading &reading)
+{
+  char json[WEATHERRACK2_JSON_SIZE];
+
+  toJSON(reading, json, sizeof(json));
+  return String(json);
+}
 
+#endif
 
-  currentJSON = returnMessageJSON();
+// Bounded receive for loop().  Makes one attempt at catching a header and, if a message arrives,
+// keeps listening WEATHERRACK2_BURST_WINDOW ms after each one for the rest of the burst so back to
+// back messages are queued rather than lost.  Never stays in the receiver longer than _deadline us.
+// Queued readings are then handed to the matching subscribers and the rest dropped, or all left
+// for read() if there are no subscribers.
+// Returns the number of new readings received
 
+int SDL_ESP32_WeatherRack2::poll()
+{
+  WeatherRack2Reading reading;
+  unsigned long window = 0;
+  int received = 0;
 
+  startCall(_deadline);
+  while (findNextMessage(reading, window))
+  {
+    queuePush(reading);
+    received++;
+#ifndef WEATHERRACK2_OVERSAMPLE
+    window = WEATHERRACK2_BURST_WINDOW * 1000UL;
+#endif
+  }
+  endCall();
+
+  boolean subscribed = false;
+  for (int i = 0; i < WEATHERRACK2_MAX_SUBSCRIPTIONS; i++)
+  {
+    if (subscriptions[i].callback != NULL)
+      subscribed = true;
+  }
+
+  if (subscribed)
+  {
+    while (read(reading))
+    {
+      dispatch(reading);
+    }
+  }
+
+  return received;
+}
+
+// Calls callback for each reading matching all the filters.  Returns a handle for unsubscribe(), or -1 if full
+
+int SDL_ESP32_WeatherRack2::subscribe(WeatherRack2Callback callback, uint8_t modelnumber, int device, uint8_t channel)
+{
+  for (int i = 0; i < WEATHERRACK2_MAX_SUBSCRIPTIONS; i++)
+  {
+    if (subscriptions[i].callback == NULL)
+    {
+      subscriptions[i].callback = callback;
+      subscriptions[i].modelnumber = modelnumber;
+      subscriptions[i].device = device;
+      subscriptions[i].channel = channel;
+      return i;
+    }
+  }
+  return -1;
+}
+
+void SDL_ESP32_WeatherRack2::unsubscribe(int subscription)
+{
+  if ((subscription >= 0) && (subscription < WEATHERRACK2_MAX_SUBSCRIPTIONS))
+    subscriptions[subscription].callback = NULL;
+}
+
+// Pops the oldest queued reading
+
+boolean SDL_ESP32_WeatherRack2::read(WeatherRack2Reading &reading)
+{
+  if (queueCount == 0)
+    return false;
+
+  reading = queue[queueHead];
+  queueHead = (queueHead + 1) % WEATHERRACK2_QUEUE_SIZE;
+  queueCount--;
+  return true;
+}
+
+int SDL_ESP32_WeatherRack2::readQueued()
+{
+  return queueCount;
+}
+
+long SDL_ESP32_WeatherRack2::readQueueDropped()
+{
+  return queueDropped;
+}
+
+// Only messages from allowed devices are decoded.  With an empty list every device is allowed.
+// A device is a modelnumber and device pair, as device numbers of different sensor types can
+// clash; WR2_MODEL_ANY allows the device number for every type.  Returns false if the list is full
+
+boolean SDL_ESP32_WeatherRack2::allowDevice(uint8_t modelnumber, uint8_t device)
+{
+  if (deviceListed(modelnumber, device))
+    return true;
+
+  if (allowedCount == WEATHERRACK2_MAX_DEVICES)
+    return false;
+
+  allowedModels[allowedCount] = modelnumber;
+  allowedDevices[allowedCount] = device;
+  allowedCount++;
+  return true;
+}
+
+void SDL_ESP32_WeatherRack2::clearAllowedDevices()
+{
+  allowedCount = 0;
+}
+
+// While learning every device is decoded and each one that sends a good message is added to the
+// allowed list.  Turn it off again to lock out the neighbours' sensors
+
+void SDL_ESP32_WeatherRack2::setAutoLearn(boolean my_autolearn)
+{
+  _autoLearn = my_autolearn;
+}
+
+// Copies the allowed (or learned) devices into modelnumbers and devices, returns how many there are
+
+int SDL_ESP32_WeatherRack2::readAllowedDevices(uint8_t *modelnumbers, uint8_t *devices, int size)
+{
+  for (int i = 0; (i < allowedCount) && (i < size); i++)
+  {
+    modelnumbers[i] = allowedModels[i];
+    devices[i] = allowedDevices[i];
+  }
+  return allowedCount;
+}
+
+// Frames abandoned after byte 2 because of an unknown sensor type or a device not allowed
+
+long SDL_ESP32_WeatherRack2::readFramesRejected()
+{
+  return framesRejected;
+}
+
+// Link quality of a device (of modelnumber, as device numbers of the two sensor types can clash) from
+// the last WEATHERRACK2_LINK_TABLE_SIZE heard.  Returns false if it is not in the table
+
+boolean SDL_ESP32_WeatherRack2::readLinkQuality(uint8_t modelnumber, uint8_t device, WeatherRack2LinkQuality &quality)
+{
+  for (int i = 0; i < WEATHERRACK2_LINK_TABLE_SIZE; i++)
+  {
+    if ((linkTable[i].framesGood > 0) && (linkTable[i].device == device) && (linkTable[i].modelnumber == modelnumber))
+    {
+      quality = linkTable[i];
+      return true;
+    }
+  }
+  return false;
+}
+
+// Copies the link quality of every device heard into table, returns how many there are
+
+int SDL_ESP32_WeatherRack2::readLinkTable(WeatherRack2LinkQuality *table, int size)
+{
+  int count = 0;
+
+  for (int i = 0; i < WEATHERRACK2_LINK_TABLE_SIZE; i++)
+  {
+    if (linkTable[i].framesGood == 0)
+      continue;
+
+    if (count < size)
+      table[count] = linkTable[i];
+    count++;
+  }
+  return count;
+}
+
+// Copies the bytes of the last complete frame (good or bad) into frame, returns the length
+
+int SDL_ESP32_WeatherRack2::readLastFrame(uint8_t *frame, int size)
+{
+  int length = (lastFrameLength < size) ? lastFrameLength : size;
+
+  memcpy(frame, lastFrame, length);
+  return length;
+}
+
+// Writes the trace ring, oldest event first, as text for extras/wr2trace:
+//   WR2TRACE <cycles per us> <events>
+//   <cycles hex> <type> <a> <b>
+//   WR2TRACE END
+
+void SDL_ESP32_WeatherRack2::dumpTrace(Print &out)
+{
+#ifdef WEATHERRACK2_TRACE
+  uint16_t count = traceWrapped ? WEATHERRACK2_TRACE_SIZE : traceNext;
+  uint16_t first = traceWrapped ? traceNext : 0;
+  char line[32];
+
+  out.print("WR2TRACE ");
+#ifdef ESP32
+  out.print(getCpuFrequencyMhz());
+#else
+  out.print(1);
+#endif
+  out.print(" ");
+  out.println(count);
+
+  for (uint16_t i = 0; i < count; i++)
+  {
+    const TraceEvent &event = traceRing[(first + i) % WEATHERRACK2_TRACE_SIZE];
+
+    snprintf(line, sizeof(line), "%08lx %u %u %u", (unsigned long)event.cycles, event.type, event.a, event.b);
+    out.println(line);
+  }
+#else
+  out.println("WR2TRACE 1 0");
+#endif
+  out.println("WR2TRACE END");
+}
+
+void SDL_ESP32_WeatherRack2::clearTrace()
+{
+#ifdef WEATHERRACK2_TRACE
+  traceNext = 0;
+  traceWrapped = false;
+#endif
+}
+
+// Heap allocations made (freed again or not) while the last message was being received, or without
+// CONFIG_HEAP_USE_HOOKS the net blocks allocated.  Should stay 0 - the receiver itself does not
+// allocate after begin().  Needs WEATHERRACK2_HEAP_STATS
+
+long SDL_ESP32_WeatherRack2::readHeapAllocationsLastMessage()
+{
+  return heapAllocationsLastMessage;
+}
+
+long SDL_ESP32_WeatherRack2::readHeapAllocationsMax()
+{
+  return heapAllocationsMax;
+}
+
+// Low water mark of the free heap since boot, or -1 if not available
+
+long SDL_ESP32_WeatherRack2::readMinFreeHeap()
+{
+#if defined(WEATHERRACK2_HEAP_STATS) && defined(ESP32)
+  return heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+#else
+  return -1;
+#endif
 }
 
 void SDL_ESP32_WeatherRack2::setTimeout(long my_timeout)
@@ -172,6 +565,28 @@ void SDL_ESP32_WeatherRack2::setTimeout(long my_timeout)
   _timeout = my_timeout;
 }
 
+void SDL_ESP32_WeatherRack2::setDeadline(unsigned long my_deadline)
+{
+  _deadline = my_deadline;
+}
+
+void SDL_ESP32_WeatherRack2::setBitTimeout(unsigned long my_bittimeout)
+{
+  _bitTimeout = my_bittimeout;
+}
+
+void SDL_ESP32_WeatherRack2::setYieldInterval(unsigned long my_yieldinterval)
+{
+  _yieldInterval = my_yieldinterval;
+}
+
+// Longest time in us a call to poll() or waitForNextJSON() has spent in the receiver
+
+unsigned long SDL_ESP32_WeatherRack2::readWorstCaseMicros()
+{
+  return worstCaseMicros;
+}
+
 void SDL_ESP32_WeatherRack2::set_ReadWeatherRack2(boolean my_read_weatherrack2)
 {
   _read_weatherrack2 = my_read_weatherrack2;
@@ -206,6 +621,126 @@ long SDL_ESP32_WeatherRack2::readSDLIndoorTHFound()
 
 //Internal functions
 
+#if defined(WEATHERRACK2_HEAP_STATS) && defined(ESP32)
+
+#if CONFIG_HEAP_USE_HOOKS
+
+// Every allocation made by the task running the receiver, counted by the ESP-IDF heap hook
+// while a call is in the receiver.  Allocations by other tasks (WiFi, lwIP) are not counted
+
+volatile unsigned long heapAllocationCount = 0;
+volatile TaskHandle_t heapStatsTask = NULL;
+
+extern "C" void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+  if ((heapStatsTask != NULL) && (xTaskGetCurrentTaskHandle() == heapStatsTask))
+    heapAllocationCount++;
+}
+
+extern "C" void esp_heap_trace_free_hook(void *ptr)
+{
+}
+
+static unsigned long heapAllocationCounter()
+{
+  return heapAllocationCount;
+}
+
+#else
+
+// Without the hooks, the blocks allocated in the whole heap: the difference across a call is a
+// net count - blocks freed again are not seen, and other tasks' allocations are included.
+// heap_caps_get_info() walks the heap, so this costs some time on every call
+
+static unsigned long heapAllocationCounter()
+{
+  multi_heap_info_t info;
+
+  heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);
+  return info.allocated_blocks;
+}
+
+#endif
+#endif
+
+// When the queue is full the oldest reading is dropped
+
+void SDL_ESP32_WeatherRack2::queuePush(const WeatherRack2Reading &reading)
+{
+  if (queueCount == WEATHERRACK2_QUEUE_SIZE)
+  {
+    queueHead = (queueHead + 1) % WEATHERRACK2_QUEUE_SIZE;
+    queueCount--;
+    queueDropped++;
+  }
+
+  queue[(queueHead + queueCount) % WEATHERRACK2_QUEUE_SIZE] = reading;
+  queueCount++;
+}
+
+boolean SDL_ESP32_WeatherRack2::deviceListed(uint8_t modelnumber, uint8_t device)
+{
+  for (int i = 0; i < allowedCount; i++)
+  {
+    if ((allowedDevices[i] == device) && ((allowedModels[i] == modelnumber) || (allowedModels[i] == WR2_MODEL_ANY)))
+      return true;
+  }
+  return false;
+}
+
+boolean SDL_ESP32_WeatherRack2::deviceAllowed(uint8_t modelnumber, uint8_t device)
+{
+  return (allowedCount == 0) || _autoLearn || deviceListed(modelnumber, device);
+}
+
+// Every public call that runs the receiver is bracketed by startCall()/endCall() so the
+// deadline can be checked down in the bit loop and the time spent recorded
+
+void SDL_ESP32_WeatherRack2::startCall(unsigned long deadline)
+{
+  callStart = micros();
+  callDeadline = deadline;
+#if defined(WEATHERRACK2_HEAP_STATS) && defined(ESP32) && CONFIG_HEAP_USE_HOOKS
+  heapStatsTask = xTaskGetCurrentTaskHandle();
+#endif
+}
+
+void SDL_ESP32_WeatherRack2::endCall()
+{
+  unsigned long elapsed = micros() - callStart;
+
+#if defined(WEATHERRACK2_HEAP_STATS) && defined(ESP32) && CONFIG_HEAP_USE_HOOKS
+  heapStatsTask = NULL;
+#endif
+
+  if (elapsed > worstCaseMicros)
+    worstCaseMicros = elapsed;
+}
+
+boolean SDL_ESP32_WeatherRack2::deadlinePassed()
+{
+  return (micros() - callStart) >= callDeadline;
+}
+
+void SDL_ESP32_WeatherRack2::dispatch(const WeatherRack2Reading &reading)
+{
+  for (int i = 0; i < WEATHERRACK2_MAX_SUBSCRIPTIONS; i++)
+  {
+    Subscription &sub = subscriptions[i];
+
+    if (sub.callback == NULL)
+      continue;
+    if ((sub.modelnumber != WR2_MODEL_ANY) && (sub.modelnumber != reading.modelnumber))
+      continue;
+    if ((sub.device != WR2_DEVICE_ANY) && (sub.device != reading.device))
+      continue;
+    if ((sub.channel != WR2_CHANNEL_ANY) && (sub.channel != reading.channel))
+      continue;
+
+    sub.callback(reading);
+  }
+}
+
 
 // Libraries
 #include <SPI.h>
@@ -246,72 +781,58 @@ int Newhum = 0;
 int ChanTemp[9];    //make one extra so we can index 1 relative
 int ChanHum[9];
 
+// Timing error of each transition against where it should be, for the link quality
+long timingErrorSum = 0;
+unsigned long timingErrorSquares = 0;
+int timingSamples = 0;
 
-#ifdef WR2DEBUG
-
-// Main RF, to find header, then sync in with it and get a packet.
-
-void flipF0300Bit(int value)
-{
-  //pinValueF0300 = pinValueF0300 ^ 1;
-  digitalWrite(PinTestF0300, value);
-
-}
-
-
-void  flipTestBit()
-{
-  pinValue = pinValue ^ 1;
-  digitalWrite(PinTest, pinValue);
-
-}
-
-void sendMessageFound()
-{
-  digitalWrite(messageFoundPin, HIGH);
-  delayMicroseconds(300);
-  digitalWrite(messageFoundPin, LOW);
-  delayMicroseconds(20);
-}
 
+long microLengthofPulse = 0;
 
-void sendHeaderBitFound()
-{
 
-  pinHeaderBitValue = pinHeaderBitValue ^ 1;
-  digitalWrite(PinHeaderBitTest, pinHeaderBitValue);
-}
 
 
-void sendHeaderFound()
+void SDL_ESP32_WeatherRack2::returnMessageJSON()
 {
+  WeatherRack2Reading reading;
 
-  pinHeaderValue = pinHeaderValue ^ 1;
-  digitalWrite(PinHeaderTest, pinHeaderValue);
+  if (findNextMessage(reading, _timeout * 1000UL))
+    toJSON(reading, currentJSON, sizeof(currentJSON));
+  else
+    strcpy(currentJSON, TIMEOUT_JSON);
 }
 
-#endif
-
-long microLengthofPulse = 0;
-boolean dataTypeDetected;
-
+// Runs the receiver until a message has been decoded into reading or timeout us have passed.
+// A timeout of 0 makes a single attempt at catching a header, which returns quickly when nothing is transmitting.
+// Gives up part way through a message if the call deadline passes or the line stops changing for _bitTimeout us
 
-
-
-String SDL_ESP32_WeatherRack2::returnMessageJSON()
+boolean SDL_ESP32_WeatherRack2::findNextMessage(WeatherRack2Reading &reading, unsigned long timeout)
 {
-
-  String returnJSON;
-  returnJSON = "";
   boolean messageFound = false;
+  unsigned long startTime = micros();
+#if defined(WEATHERRACK2_HEAP_STATS) && defined(ESP32)
+  unsigned long heapAllocations = heapAllocationCounter();
+#endif
 
+#ifdef WEATHERRACK2_OVERSAMPLE
+  // the samples are buffered, so anything already received is decoded at once and
+  // the rest of the timeout is spent asleep waiting for more
+  while (!(messageFound = decodeSamples()) && (micros() - startTime < timeout) && !deadlinePassed())
+  {
+    delay(1);
+  }
+#else
+  unsigned long lastYield = startTime;
 
-
-  long endTime =   millis() + _timeout * 1000;
-
-
-  while ((returnJSON.length() == 0) && (endTime > millis()))
+  do
   {
+    // safe to give other tasks a turn between attempts, never part way through a message
+    if ((_yieldInterval != 0) && (micros() - lastYield >= _yieldInterval))
+    {
+      yield();
+      lastYield = micros();
+    }
+
     tempBit = polarity; //these begin the same for a packet
     noErrors = true;
     firstZero = false;
@@ -319,7 +840,9 @@ String SDL_ESP32_WeatherRack2::returnMessageJSON()
     nosBits = 6;
     nosBytes = 0;
     long currentDelay = 0;
-    dataTypeDetected = false;
+    timingErrorSum = 0;
+    timingErrorSquares = 0;
+    timingSamples = 0;
 
 
     while (noErrors && (nosBytes < maxBytes))
@@ -337,34 +860,43 @@ String SDL_ESP32_WeatherRack2::returnMessageJSON()
         //pause here until a transition is found
         currentDelay = (micros() - microLengthofPulse);
 
-
-
-
-
-
+        if (NotFoundTran && ((currentDelay > (long)_bitTimeout) || deadlinePassed()))
+        {
+          noErrors = false; //line is stuck or out of time, abandon this attempt
+          if (headerHits >= headerBits)
+            WR2_TRACE(WR2T_ERROR, WR2T_ERROR_TIMEOUT, nosBytes);
+          break;
+        }
 
       }//at Data transition, half way through bit pattern, this should be where RxPin==tempBit
 
+      if (!noErrors)
+        break;
+
+      if (headerHits > 0)
+      {
+        // locked on, so the transition should come sDelay after the last sample point
+        long timingError = currentDelay - sDelay;
+        timingErrorSum += timingError;
+        timingErrorSquares += timingError * timingError;
+        timingSamples++;
+      }
 
 
 
       delayMicroseconds(sDelay);//skip ahead to 3/4 of the bit pattern
-#ifdef WR2DEBUG
-      flipTestBit();
-#endif
 
       // 3/4 the way through, if RxPin has changed it is definitely an error
       if (digitalRead(RxPin) != tempBit)
       {
         noErrors = false; //something has gone wrong, polarity has changed too early, ie always an error
+        if (headerHits >= headerBits)
+          WR2_TRACE(WR2T_ERROR, WR2T_ERROR_EARLY, nosBytes);
       }//exit and retry
       else
       {
 
         delayMicroseconds(lDelay);
-#ifdef WR2DEBUG
-        flipTestBit();
-#endif
         //now 1 quarter into the next bit pattern,
         if (digitalRead(RxPin) == tempBit) //if RxPin has not swapped, then bitWaveform is swapping
         {
@@ -376,76 +908,288 @@ String SDL_ESP32_WeatherRack2::returnMessageJSON()
         //Now process the tempBit state and make data definite 0 or 1's, allow possibility of Pos or Neg Polarity
         byte bitState = tempBit ^ polarity;//if polarity=1, invert the tempBit or if polarity=0, leave it alone.
 
+        // only once a header has been seen, or noise would fill the ring
+        if (headerHits >= headerBits)
+          WR2_TRACE(WR2T_BIT, bitState, currentDelay);
 
-        if (bitState == 1) //1 data could be header or packet
-        {
-          if (!firstZero)
-          {
-            headerHits++;
-#ifdef WR2DEBUG
-            sendHeaderBitFound();
-#endif
-
-            if (headerHits == headerBits)
-            {
-              //Serial.print("H");
-#ifdef WR2DEBUG
-              sendHeaderFound();
-#endif
-              headersFound++;
-            }
-
-          }
-          else
-          {
-            returnJSON = add(bitState);//already seen first zero so add bit in
-          }
-        }//end of dealing with ones
-        else
-        { //bitState==0 could first error, first zero or packet
-          // if it is header there must be no "zeroes" or errors
-          if (headerHits < headerBits)
-          {
-            //Still in header checking phase, more header hits required
-            noErrors = false; //landing here means header is corrupted, so it is probably an error
-          }//end of detecting a "zero" inside a header
-          else
-          {
-            //we have our header, chewed up any excess and here is a zero
-            if (!firstZero) //if first zero, it has not been found previously
-            {
-              firstZero = true;
-              returnJSON = add(bitState);//Add first zero to bytes
-              //Serial.print("!");
-            }//end of finding first zero
-            else
-            {
-              returnJSON = add(bitState);
-            }//end of adding a zero bit
-          }//end of dealing with a first zero
-        }//end of dealing with zero's (in header, first or later zeroes)
+        messageFound = processBit(bitState);
       }//end of first error check
 
     }//end of while noErrors=true and getting packet of bytes
 
-  } //end of while
+  } while (!messageFound && (micros() - startTime < timeout) && !deadlinePassed());
+#endif
 
+  if (messageFound)
+  {
+    reading = decodedReading;
+    if (_autoLearn)
+      allowDevice(reading.modelnumber, reading.device);
+#if defined(WEATHERRACK2_HEAP_STATS) && defined(ESP32)
+    heapAllocationsLastMessage = (long)(heapAllocationCounter() - heapAllocations);
+    if (heapAllocationsLastMessage > heapAllocationsMax)
+      heapAllocationsMax = heapAllocationsLastMessage;
+#endif
+  }
+  return messageFound;
+}
 
-  if (endTime <= millis())
-    returnJSON = TimeOutJSON;
+// Takes each decoded bit through header detection and on into add().  A zero inside the
+// header clears noErrors.  Returns true when add() has completed a good message
 
-  if (returnJSON.length() == 0)
-    returnJSON = ErrorJSON;
-  return returnJSON;
+boolean SDL_ESP32_WeatherRack2::processBit(byte bitState)
+{
+  if (bitState == 1) //1 data could be header or packet
+  {
+    if (!firstZero)
+    {
+      headerHits++;
+
+      if (headerHits == headerBits)
+      {
+        //Serial.print("H");
+        headersFound++;
+        WR2_TRACE(WR2T_HEADER, headerHits, 0);
+      }
+
+    }
+    else
+    {
+      return add(bitState);//already seen first zero so add bit in
+    }
+  }//end of dealing with ones
+  else
+  { //bitState==0 could first error, first zero or packet
+    // if it is header there must be no "zeroes" or errors
+    if (headerHits < headerBits)
+    {
+      //Still in header checking phase, more header hits required
+      noErrors = false; //landing here means header is corrupted, so it is probably an error
+    }//end of detecting a "zero" inside a header
+    else
+    {
+      //we have our header, chewed up any excess and here is a zero
+      if (!firstZero) //if first zero, it has not been found previously
+      {
+        firstZero = true;
+        //Serial.print("!");
+        return add(bitState);//Add first zero to bytes
+      }//end of finding first zero
+      else
+      {
+        return add(bitState);
+      }//end of adding a zero bit
+    }//end of dealing with a first zero
+  }//end of dealing with zero's (in header, first or later zeroes)
+
+  return false;
 }
 
-//Read the binary data from the bank and apply conversions where necessary to scale and format data
+#ifdef WEATHERRACK2_OVERSAMPLE
+
+// Decodes the buffered samples a Manchester bit at a time, the way the delay decoder does but
+// without waiting.  The decoder keeps a bit clock - the position of the last mid bit transition
+// and the bit period, in sixteenths of a sample - and each bit is the direction of the
+// transition nearest to where the clock says the next one should be.  The clock is pulled
+// towards every transition it finds, so it follows a sensor whose clock is a few percent out,
+// and the error on one jittery transition is averaged with the ones before it.
+// Returns true when a message has been decoded.  When the samples run out the decoder state
+// is kept, and the next call carries on where this one stopped
+
+boolean SDL_ESP32_WeatherRack2::decodeSamples()
+{
+  while (!deadlinePassed())
+  {
+    uint32_t available = samplesWritten - samplePosition;
+
+    if (available > (WEATHERRACK2_SAMPLE_WORDS - 2) * 32UL)
+    {
+      // the sampler has lapped us, skip to the newest half of the ring
+      samplePosition = samplesWritten - WEATHERRACK2_SAMPLE_WORDS * 16UL;
+      sampleLocked = false;
+      sampleOverruns++;
+      continue;
+    }
+
+    if (available < 32 + 6)
+      return false;
+
+    uint32_t samples = samplesAt(samplePosition);
+
+    if (!sampleLocked)
+    {
+      // Hunt for the mid bit transition of a 1 (hi->lo for polarity 1) - in a header of 1s the
+      // transitions at the bit boundaries all go the other way.  Bit 31 needs the next word's
+      // first sample, so it is left for the next look
+      uint32_t edges = polarity ? (samples & ~(samples >> 1)) : (~samples & (samples >> 1));
+
+      edges &= 0x7FFFFFFF;
+      if (edges == 0)
+      {
+        samplePosition += 31;
+        continue;
+      }
+
+      samplePosition += __builtin_ctz(edges);
+      samplePhase = 8;
+      samplePeriod = 128;
+      sampleLocked = true;
+
+      tempBit = polarity;
+      noErrors = true;
+      firstZero = false;
+      headerHits = 0;
+      nosBits = 6;
+      nosBytes = 0;
+      timingErrorSum = 0;
+      timingErrorSquares = 0;
+      timingSamples = 0;
+
+      processBit(1);
+      continue;
+    }
+
+    // The next mid bit transition is expected a bit period after the last one; take the
+    // transition nearest to that among the 3 samples either side.  Those at the bit boundaries
+    // are half a bit (4 samples) away
+    int expected = samplePhase + samplePeriod;
+    int centre = expected >> 4;
+    uint32_t window = samplesAt(samplePosition + centre - 3);
+    uint32_t transitions = (window ^ (window >> 1)) & 0x3F;
+    boolean messageFound = false;
+    int nearest = -1;
+    int timingError = 0;
+
+    while (transitions != 0)
+    {
+      int i = __builtin_ctz(transitions);
+      int error = (centre - 3 + i) * 16 + 8 - expected;
+
+      transitions &= transitions - 1;
+      if ((nearest < 0) || (abs(error) < abs(timingError)))
+      {
+        nearest = i;
+        timingError = error;
+      }
+    }
+
+    if (nearest < 0)
+    {
+      noErrors = false;
+      if (headerHits >= headerBits)
+        WR2_TRACE(WR2T_ERROR, WR2T_ERROR_TIMEOUT, nosBytes);
+    }
+    else
+    {
+      if (headerHits > 0)
+      {
+        timingErrorSum += (long)timingError * WEATHERRACK2_SAMPLE_PERIOD / 16;
+        timingErrorSquares += (unsigned long)(timingError * timingError) * WEATHERRACK2_SAMPLE_PERIOD * WEATHERRACK2_SAMPLE_PERIOD / 256;
+        timingSamples++;
+      }
+
+      // Move the bit clock half way to the transition and its period a sixteenth of the way,
+      // so that jitter on one transition is averaged out but clock error is followed
+      samplePeriod += timingError / 16;
+      if (samplePeriod < 120)
+        samplePeriod = 120;
+      else if (samplePeriod > 136)
+        samplePeriod = 136;
+      int mid = expected + timingError / 2;
+      samplePosition += mid >> 4;
+      samplePhase = mid & 15;
+
+      // a hi->lo mid bit transition is a 1 with polarity 1
+      messageFound = processBit(((window >> nearest) & 1) ^ polarity ^ 1);
+    }
+
+    if (messageFound || !noErrors || (nosBytes >= maxBytes))
+    {
+      // hunt again from just after the end of the message, or the last good transition
+      samplePosition++;
+      sampleLocked = false;
+      if (messageFound)
+        return true;
+    }
+  }
+
+  return false;
+}
+
+// Adds count words of 32 samples (the oldest in bit 0) for sampling other than by the timer,
+// e.g. from I2S or a capture file
+
+void SDL_ESP32_WeatherRack2::feedSamples(const uint32_t *words, int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    uint32_t n = samplesWritten;
+    uint32_t index = n >> 5;
+    uint8_t shift = n & 31;
+
+    if (shift == 0)
+    {
+      sampleRing[index % WEATHERRACK2_SAMPLE_WORDS] = words[i];
+    }
+    else
+    {
+      volatile uint32_t &samples = sampleRing[index % WEATHERRACK2_SAMPLE_WORDS];
+      samples = (samples & ((1UL << shift) - 1)) | (words[i] << shift);
+      sampleRing[(index + 1) % WEATHERRACK2_SAMPLE_WORDS] = words[i] >> (32 - shift);
+    }
+    samplesWritten = n + 32;
+  }
+}
+
+// Times decodeSamples() fell more than a ring of samples behind and lost some
 
-String SDL_ESP32_WeatherRack2::add(byte bitData)
+long SDL_ESP32_WeatherRack2::readSampleOverruns()
 {
-#ifdef WR2DEBUG
-  flipF0300Bit(bitData);
+  return sampleOverruns;
+}
+
+#endif
+
+// Formats reading into json without using the heap. Returns the length as snprintf does
+
+int SDL_ESP32_WeatherRack2::toJSON(const WeatherRack2Reading &reading, char *json, int size)
+{
+#if WEATHERRACK2_DECODE_INDOORTH
+#if WEATHERRACK2_DECODE_WEATHERRACK2
+  if (reading.modelnumber == WR2_MODEL_F016TH)
 #endif
+  {
+    return snprintf(json, size,
+                    "{\"messageid\" : \"%ld\", \"time\" : \"\", "
+                    "\"model\" : \"SwitchDoc Labs F016TH Thermo-Hygrometer\", "
+                    "\"device\" : \"%d\", \"modelnumber\" : \"5\", \"channel\" : \"%d\", \"battery\" : \"%s\", "
+                    "\"temperature\" : \"%.2f\", \"humidity\" : \"%d\", \"CRC\" : \"%x\"}",
+                    reading.messageID,
+                    reading.device, reading.channel, reading.batteryLow ? "LOW" : "OK",
+                    reading.temperature, reading.humidity, reading.CRC);
+  }
+#endif
+
+#if WEATHERRACK2_DECODE_WEATHERRACK2
+  return snprintf(json, size,
+                  "{\"messageid\" : \"%ld\", \"time\" : \"\", "
+                  "\"model\" : \"SwitchDoc Labs FT020T AIO\", "
+                  "\"device\" : \"%d\", \"modelnumber\" : \"12\", \"battery\" : \"%s\", "
+                  "\"avewindspeed\" : \"%u\", \"gustwindspeed\" : \"%u\", \"winddirection\" : \"%u\", "
+                  "\"cumulativerain\" : \"%lu\", \"temperature\" : \"%.2f\", \"humidity\" : \"%d\", "
+                  "\"light\" : \"%lu\", \"uv\" : \"%u\", \"CRC\" : \"%x\"}",
+                  reading.messageID,
+                  reading.device, reading.batteryLow ? "LOW" : "OK",
+                  reading.avewindspeed, reading.gustwindspeed, reading.winddirection,
+                  (unsigned long)reading.cumulativerain, reading.temperature, reading.humidity,
+                  (unsigned long)reading.light, reading.uv, reading.CRC);
+#endif
+}
+
+//Read the binary data from the bank and apply conversions where necessary to scale and format data
+
+boolean SDL_ESP32_WeatherRack2::add(byte bitData)
+{
   dataByte = (dataByte << 1) | bitData;
   nosBits++;
   if (nosBits == 8)
@@ -458,52 +1202,66 @@ String SDL_ESP32_WeatherRack2::add(byte bitData)
     //Serial.print(nosBytes);
     //Serial.print(dataByte, HEX);
     //Serial.print(" ");
-  }
-
-
-  if ((maxBytes != 16) && (nosBytes > 1) && (!dataTypeDetected))
-  {
 
-    dataType = manchester[1];
-
-    if (dataType == 0x4C) {
+    // Byte 1 is the sensor type and byte 2 the device, so frames we are not going to use are
+    // abandoned here and the receiver goes back to hunting for a header.  Types not compiled in,
+    // or switched off with set_ReadWeatherRack2() / set_ReadIndoorth(), are rejected with the rest
+    if (nosBytes == 2)
+    {
+      dataType = manchester[1];
 
-#ifdef WR2DEBUG
-      Serial.println (dataType, HEX);
+#if WEATHERRACK2_DECODE_WEATHERRACK2
+      if ((dataType == 0x4C) && _read_weatherrack2)
+      {
+        maxBytes = 16;
+      }
+      else
+#endif
+#if WEATHERRACK2_DECODE_INDOORTH
+      if ((dataType == 0x45) && _read_indoorth)
+      {
+        maxBytes = MAX_BYTES;
+      }
+      else
 #endif
-      maxBytes = 16;
-      dataTypeDetected = true;
+      {
+        framesRejected++;
+        noErrors = false;
+        WR2_TRACE(WR2T_RESULT, WR2T_RESULT_REJECTED_TYPE, dataType);
+        return false;
+      }
+    }
+    else if ((nosBytes == 3) && !deviceAllowed((dataType == 0x4C) ? WR2_MODEL_FT020T : WR2_MODEL_F016TH, manchester[2]))
+    {
+      framesRejected++;
+      noErrors = false;
+      WR2_TRACE(WR2T_RESULT, WR2T_RESULT_REJECTED_DEVICE, manchester[2]);
+      return false;
     }
-
-
-
-
   }
 
   if (nosBytes == maxBytes)
   {
-
+    memcpy(lastFrame, manchester, maxBytes);
+    lastFrameLength = maxBytes;
+    WR2_TRACE(WR2T_FRAME, maxBytes, manchester[1]);
 
     dataByte = 0xFF;
     // Subroutines to extract data from Manchester encoding and error checking
 
+    // Identify sensor by looking for sensorID in byte 1 (F016TH  Thermo-Hygrometer = 0x45)
+    dataType = manchester[1];
+    int device = manchester[2];
+
+#if WEATHERRACK2_DECODE_INDOORTH
     // Identify channels 1 to 8 by looking at 3 bits in byte 3
     int stnId = ((manchester[3] & B01110000) / 16) + 1;
 
     int battery = (manchester[3] & B1000000);
-    String myBattery;
-    if (battery == 0)
-      myBattery = "OK";
-    else
-      myBattery = "LOW";
 
     float tempc;
 
 
-    // Identify sensor by looking for sensorID in byte 1 (F016TH  Thermo-Hygrometer = 0x45)
-    dataType = manchester[1];
-    int device = manchester[2];
-
     // Gets raw temperature from bytes 3 and 4 (note this is neither C or F but a value from the sensor)
     Newtemp = (float((manchester[3] & B00000111) * 256) + manchester[4]);
 
@@ -512,12 +1270,6 @@ String SDL_ESP32_WeatherRack2::add(byte bitData)
 
     int myFT007CalculatedChecksum = Checksum(7 - 2, manchester + 1);
     int myFT007Checksum = manchester[6];
-#ifdef WR2DEBUG
-    Serial.print("007CalChecksum=");
-    Serial.println(myFT007CalculatedChecksum, HEX);
-    Serial.print("myFT007Checksum=");
-    Serial.println(myFT007Checksum, HEX);
-#endif
 
 
     if (myFT007CalculatedChecksum == myFT007Checksum)
@@ -528,69 +1280,37 @@ String SDL_ESP32_WeatherRack2::add(byte bitData)
       if ((dataType == 0x45) && (Newhum <= 100))
       {
         FT007MessagesFound++;
-        //sendMessageFound();
 
         ChanTemp[stnId] = Newtemp;
         ChanHum[stnId] = Newhum;
 
         // print raw data
-#ifdef WR2DEBUG
-        char Buff[128];
-
-        for (int i = 0; i < maxBytes; i++)
-        {
-          sprintf(&Buff[i * 3], "%02X ", manchester[i]);
-        }
-
-        // 123456789 123456789 1234
-        // Channel=1 F=123.1 H=12%<
-        sprintf(&Buff[maxBytes * 3], "  Channel=%d F=%d.%d H=%d%%\n",
-                stnId,
-                (Newtemp - 400) / 10,
-                Newtemp - (Newtemp / 10) * 10,
-                Newhum);
-        Serial.print(Buff);
-
-
-
-        Serial.print("Headers found ="); Serial.println(headersFound);
-        Serial.print("FT007 Messages found="); Serial.println(FT007MessagesFound);
-        Serial.print("FT300 Messages found="); Serial.println(FT300MessagesFound);
-#endif
         tempc = float(Newtemp - 400) / 10.0;
         tempc = (tempc - 32.0) * (5.0 / 9.0);
 
-      }
-
-
-      messageID++;
+        messageID++;
 
-      String myJSON;
-      myJSON =  "{\"messageid\" : \"" + String(messageID) + "\", ";
-      myJSON +=  "\"time\" : \"\", ";
-      myJSON +=  "\"model\" : \"SwitchDoc Labs F016TH Thermo-Hygrometer\", ";
-      myJSON +=  "\"device\" : \"" + String(device) + "\", ";
-      myJSON +=  "\"modelnumber\" : \"5\", ";
-      myJSON +=  "\"channel\" : \"" + String(stnId) + "\", ";
-      myJSON +=  "\"battery\" : \"" + myBattery + "\", ";
-      myJSON +=  "\"temperature\" : \"" + String(tempc) + "\", ";
-      myJSON +=  "\"humidity\" : \""     + String(Newhum) + "\", ";
-      myJSON +=  "\"CRC\" : \"" + String(myFT007CalculatedChecksum, HEX) + "\"}";
-      return myJSON;
+        memset(&decodedReading, 0, sizeof(decodedReading));
+        decodedReading.messageID = messageID;
+        decodedReading.modelnumber = WR2_MODEL_F016TH;
+        decodedReading.device = device;
+        decodedReading.channel = stnId;
+        decodedReading.batteryLow = (battery != 0);
+        decodedReading.temperature = tempc;
+        decodedReading.humidity = Newhum;
+        decodedReading.CRC = myFT007CalculatedChecksum;
+        updateLink(WR2_MODEL_F016TH, device, true);
+        WR2_TRACE(WR2T_RESULT, WR2T_RESULT_GOOD, device);
+        return true;
+      }
 
     }
+#endif
 
-
+#if WEATHERRACK2_DECODE_WEATHERRACK2
     if ((dataType == 0x4C))
     {
-#ifdef WR2DEBUG
-      Serial.println("FT202T found");
-#endif
       FT300MessagesFound++;
-#ifdef WR2DEBUG
-      sendMessageFound();
-      sendMessageFound();
-#endif
       // print raw data
       char Buff[128];
 
@@ -622,17 +1342,6 @@ String SDL_ESP32_WeatherRack2::add(byte bitData)
 
       }
 
-#ifdef WR2DEBUG
-      for (i = 0; i < 17; i++)
-      {
-        Serial.print("b2[");
-        Serial.print(i);
-        Serial.print("]=");
-        Serial.print( b2[i], HEX);
-        Serial.print(" ");
-      }
-      Serial.println();
-#endif
 
 
 
@@ -665,35 +1374,7 @@ String SDL_ESP32_WeatherRack2::add(byte bitData)
         myUV = b2[12];
         //myUV = myUV + 10;
 
-        String myBattery;
-        if (myBatteryLow == 0)
-          myBattery = "OK";
-        else
-          myBattery = "LOW";
-
-
-#ifdef WR2DEBUG
-
-        Serial.print("myDevice = "); Serial.print(myDevice, HEX  ); Serial.print(" "); Serial.println(myDevice);
-        Serial.print("mySerial = "); Serial.print(mySerial, HEX  ); Serial.print(" "); Serial.println(mySerial );
-        Serial.print("myFlags = "); Serial.print(myFlags, HEX  ); Serial.print(" "); Serial.println(myFlags );
-        Serial.print("myBatteryLow = "); Serial.print( myBatteryLow, HEX   ); Serial.print(" "); Serial.println( myBatteryLow  );
-        Serial.print("myAveWindSpeed = "); Serial.print( myAveWindSpeed, HEX  ); Serial.print(" "); Serial.println( myAveWindSpeed );
-        Serial.print("myGust = "); Serial.print( myGust, HEX  ); Serial.print(" "); Serial.println( myGust );
-        Serial.print("myWindDirection = "); Serial.print(  myWindDirection, HEX  ); Serial.print(" "); Serial.println(  myWindDirection  );
-        Serial.print("myCumulativeRain = "); Serial.print(  myCumulativeRain, HEX  ); Serial.print(" "); Serial.println( myCumulativeRain  );
-        Serial.print("mySecondFlags = "); Serial.print( mySecondFlags, HEX  ); Serial.print(" "); Serial.println( mySecondFlags );
-        Serial.print("myTemperature = "); Serial.print( myTemperature, HEX  ); Serial.print(" "); Serial.println( myTemperature);
-        Serial.print("myHumidity = "); Serial.print( myHumidity, HEX  ); Serial.print(" "); Serial.println( myHumidity);
-        Serial.print("myLight = "); Serial.print( myLight, HEX  ); Serial.print(" "); Serial.println( myLight );
-        Serial.print("myUV = "); Serial.print( myUV, HEX  ); Serial.print(" "); Serial.println( myUV );
-        Serial.print("myCRC = "); Serial.print(  myCRC, HEX  ); Serial.print(" "); Serial.println(  myCRC);
-        Serial.print("myCalculated  ="); Serial.print(  myCalculated, HEX  ); Serial.print(" "); Serial.println(  myCalculated  );
-
-        Serial.print("Headers found ="); Serial.println(headersFound);
-        Serial.print("FT007 Messages found="); Serial.println(FT007MessagesFound);
-        Serial.print("FT300 Messages found="); Serial.println(FT300MessagesFound);
-#endif
+
         float tempc;
 
         tempc = float(myTemperature - 400) / 10.0;
@@ -701,36 +1382,139 @@ String SDL_ESP32_WeatherRack2::add(byte bitData)
 
         messageID++;
 
-        String myJSON;
-        myJSON =  "{\"messageid\" : \"" + String(messageID) + "\", ";
-        myJSON +=  "\"time\" : \"\", ";
-        myJSON +=  "\"model\" : \"SwitchDoc Labs FT020T AIO\", ";
-        myJSON +=  "\"device\" : \"" + String(device) + "\", ";
-        myJSON +=  "\"modelnumber\" : \"12\", ";
-        myJSON +=  "\"battery\" : \"" + myBattery + "\", ";
-        myJSON +=  "\"avewindspeed\" : \"" + String(myAveWindSpeed) + "\", ";
-        myJSON +=  "\"gustwindspeed\" : \"" + String(myGust) + "\", ";
-        myJSON +=  "\"winddirection\" : \"" + String( myWindDirection) + "\", ";
-        myJSON +=  "\"cumulativerain\" : \"" + String(myCumulativeRain) + "\", ";
-        myJSON +=  "\"temperature\" : \"" + String(tempc) + "\", ";
-        myJSON +=  "\"humidity\" : \"" + String(myHumidity) + "\", ";
-        myJSON +=  "\"light\" : \"" + String(myLight) + "\", ";
-        myJSON +=  "\"uv\" : \"" + String(myUV) + "\", ";
-        myJSON +=  "\"CRC\" : \"" + String(myCalculated, HEX) + "\"}";
-        return myJSON;
+        memset(&decodedReading, 0, sizeof(decodedReading));
+        decodedReading.messageID = messageID;
+        decodedReading.modelnumber = WR2_MODEL_FT020T;
+        decodedReading.device = device;
+        decodedReading.batteryLow = (myBatteryLow != 0);
+        decodedReading.temperature = tempc;
+        decodedReading.humidity = myHumidity;
+        decodedReading.avewindspeed = myAveWindSpeed;
+        decodedReading.gustwindspeed = myGust;
+        decodedReading.winddirection = myWindDirection;
+        decodedReading.cumulativerain = myCumulativeRain;
+        decodedReading.light = myLight;
+        decodedReading.uv = myUV;
+        decodedReading.CRC = myCalculated;
+        updateLink(WR2_MODEL_FT020T, device, true);
+        WR2_TRACE(WR2T_RESULT, WR2T_RESULT_GOOD, device);
+        return true;
 
       }
-      else
-      {
-        Serial.println("FT020T Bad CRC");
-      }
 
     }
+#endif
+
+    // complete frame that failed its checksum or range checks
+    updateLink((dataType == 0x4C) ? WR2_MODEL_FT020T : WR2_MODEL_F016TH, device, false);
+    WR2_TRACE(WR2T_RESULT, WR2T_RESULT_BAD, device);
 
 
   } // set to 16 as dataype = 4C
 
-  return ErrorJSON;
+  return false;
+}
+
+// Updates the link quality of a device as each complete frame arrives.  Devices are only added on
+// a good frame, failed frames are counted against devices already in the table.
+// Copies per burst are folded in when the next burst from the device starts, along with a burst
+// of no copies for each burst missed altogether - taking the shortest time seen between the
+// starts of two bursts as the sensor's interval
+
+void SDL_ESP32_WeatherRack2::updateLink(uint8_t modelnumber, uint8_t device, boolean good)
+{
+  unsigned long now = millis();
+  int entry = -1;
+  int oldest = 0;
+
+  for (int i = 0; i < WEATHERRACK2_LINK_TABLE_SIZE; i++)
+  {
+    WeatherRack2LinkQuality &link = linkTable[i];
+
+    if ((link.framesGood > 0) && (link.device == device) && (link.modelnumber == modelnumber))
+    {
+      entry = i;
+      break;
+    }
+
+    if ((link.framesGood == 0) || ((linkTable[oldest].framesGood > 0) && (now - link.lastSeen > now - linkTable[oldest].lastSeen)))
+      oldest = i;
+  }
+
+  if (entry < 0)
+  {
+    if (!good)
+      return;
+
+    // new device, replaces the one heard least recently
+    WeatherRack2LinkQuality &link = linkTable[oldest];
+    link.device = device;
+    link.modelnumber = modelnumber;
+    link.framesGood = 0;
+    link.framesBad = 0;
+    link.timingVariance = 0;
+    link.copiesRatio = 1.0;
+    link.failureRate = 0;
+    link.burstCopies = 0;
+    link.copiesPerBurst = WEATHERRACK2_COPIES_PER_BURST;
+    link.burstStart = now;
+    link.burstInterval = 0;
+    link.lastSeen = now;
+    entry = oldest;
+  }
+
+  WeatherRack2LinkQuality &link = linkTable[entry];
+
+  if (!good)
+  {
+    link.framesBad++;
+    link.failureRate += WEATHERRACK2_LINK_ALPHA * (1.0 - link.failureRate);
+  }
+  else
+  {
+    if ((link.burstCopies > 0) && (now - link.lastSeen > WEATHERRACK2_LINK_BURST_GAP))
+    {
+      unsigned long interval = now - link.burstStart;
+
+      if (link.burstCopies > link.copiesPerBurst)
+        link.copiesPerBurst = link.burstCopies;
+      link.copiesRatio += WEATHERRACK2_LINK_ALPHA * ((float)link.burstCopies / link.copiesPerBurst - link.copiesRatio);
+
+      if ((link.burstInterval == 0) || (interval < link.burstInterval))
+        link.burstInterval = interval;
+      unsigned long missed = (interval + link.burstInterval / 2) / link.burstInterval - 1;
+      if (missed > 0)
+        link.copiesRatio *= pow(1.0 - WEATHERRACK2_LINK_ALPHA, missed);
+
+      link.burstCopies = 0;
+      link.burstStart = now;
+    }
+    link.burstCopies++;
+
+    if (timingSamples > 0)
+    {
+      float mean = (float)timingErrorSum / timingSamples;
+      float variance = (float)timingErrorSquares / timingSamples - mean * mean;
+
+      // E[x^2] - mean^2 can come out just below 0 from float rounding, and goes into sqrt() below
+      if (variance < 0)
+        variance = 0;
+
+      if (link.framesGood == 0)
+        link.timingVariance = variance;
+      else
+        link.timingVariance += WEATHERRACK2_LINK_ALPHA * (variance - link.timingVariance);
+    }
+
+    link.framesGood++;
+    link.failureRate -= WEATHERRACK2_LINK_ALPHA * link.failureRate;
+    link.lastSeen = now;
+  }
+
+  // 0-100: copies heard x frames passing x how much of the sDelay sampling margin the jitter leaves
+  float jitter = sqrt(link.timingVariance);
+  float margin = (jitter < sDelay) ? 1.0 - jitter / sDelay : 0;
+  link.quality = 100.0 * link.copiesRatio * (1.0 - link.failureRate) * margin + 0.5;
 }
 
 void SDL_ESP32_WeatherRack2::eraseManchester()
@@ -742,6 +1526,7 @@ void SDL_ESP32_WeatherRack2::eraseManchester()
 }
 
 
+#if WEATHERRACK2_DECODE_INDOORTH
 uint8_t SDL_ESP32_WeatherRack2::Checksum(int length, uint8_t *buff)
 {
   uint8_t mask = 0x7C;
@@ -776,7 +1561,9 @@ uint8_t SDL_ESP32_WeatherRack2::Checksum(int length, uint8_t *buff)
   }
   return checksum;
 }
+#endif
 
+#if WEATHERRACK2_DECODE_WEATHERRACK2
 //============================================================================================
 // CRC table
 //============================================================================================
@@ -814,3 +1601,4 @@ uint8_t SDL_ESP32_WeatherRack2::GetCRC(uint8_t crc, uint8_t * lpBuff, uint8_t uc
   }
   return crc;
 }
+#endif
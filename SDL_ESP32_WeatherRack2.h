@@ -5,6 +5,9 @@
 //
 //
 
+#ifndef SDL_ESP32_WEATHERRACK2_H
+#define SDL_ESP32_WEATHERRACK2_H
+
 #if ARDUINO >= 100
 #include "Arduino.h"
 #else
@@ -12,28 +15,167 @@
 #endif
 
 
-#define WEATHERRACK2_TIMEOUT 500
+#define WEATHERRACK2_TIMEOUT 500            // ms waitForNextJSON() waits for a message
+#define WEATHERRACK2_DEADLINE 500000         // us any call to poll() may stay in the receiver (a burst)
+#define WEATHERRACK2_BIT_TIMEOUT 2000        // us to wait for a Manchester transition (about 2 bits)
+#define WEATHERRACK2_YIELD_INTERVAL 10000    // us between yield() calls while hunting for a header, 0 = never
 #define READ_WEATHERRACK2 true
 #define READ_SDL_INDOOR_TH true
 
+// Sensor types compiled into the decoder.  Set one to 0 (here or with -D) to leave its frame
+// handling, checksum and JSON out of the build.  READ_ / set_Read flags pick among those compiled in
+#ifndef WEATHERRACK2_DECODE_WEATHERRACK2
+#define WEATHERRACK2_DECODE_WEATHERRACK2 1   // FT020T AIO, type 0x4C, 16 byte frames
+#endif
+#ifndef WEATHERRACK2_DECODE_INDOORTH
+#define WEATHERRACK2_DECODE_INDOORTH 1       // F016TH Thermo-Hygrometer, type 0x45, 7 byte frames
+#endif
+
+#if !WEATHERRACK2_DECODE_WEATHERRACK2 && !WEATHERRACK2_DECODE_INDOORTH
+#error "SDL_ESP32_WeatherRack2: no sensor types enabled"
+#endif
+
 #define RX_IN_PIN 32
 
+// #define WEATHERRACK2_NO_STRING   // getCurrentJSON() and waitForNextJSON() return const char * - no heap use after begin()
+// #define WEATHERRACK2_HEAP_STATS  // ESP32: count heap allocations made while each message is received (net blocks without CONFIG_HEAP_USE_HOOKS)
+// #define WEATHERRACK2_TRACE       // record decoder events in a RAM ring for dumpTrace()
+// #define WEATHERRACK2_OVERSAMPLE  // sample RX_IN_PIN from a timer interrupt and decode the buffered samples, no busy waiting
+
+#define WEATHERRACK2_JSON_SIZE 400
+#define WEATHERRACK2_TRACE_SIZE 1024    // events, 8 bytes each
+
+#define WEATHERRACK2_SAMPLE_PERIOD 122      // us between samples with WEATHERRACK2_OVERSAMPLE, 8 to a Manchester bit
+#define WEATHERRACK2_SAMPLE_WORDS 256       // 32 samples each, a power of 2 (256 is about 1 second)
+#define WEATHERRACK2_SAMPLE_TIMER 0         // ESP32 hardware timer that drives the sampling (2.x cores, 3.x picks a free one)
+
+// trace event types and their a / b values
+#define WR2T_HEADER 1                   // headerHits / -
+#define WR2T_BIT 2                      // bit / us waited for the transition
+#define WR2T_ERROR 3                    // WR2T_ERROR_ reason / bytes received
+#define WR2T_FRAME 4                    // bytes / sensor type (byte 1)
+#define WR2T_RESULT 5                   // WR2T_RESULT_ / device (sensor type if rejected on type)
+
+#define WR2T_ERROR_EARLY 1              // transition before 3/4 of the bit
+#define WR2T_ERROR_TIMEOUT 2            // no transition within _bitTimeout, or the deadline passed
+
+#define WR2T_RESULT_BAD 0
+#define WR2T_RESULT_GOOD 1
+#define WR2T_RESULT_REJECTED_TYPE 2
+#define WR2T_RESULT_REJECTED_DEVICE 3
+
+#define WEATHERRACK2_QUEUE_SIZE 8
+#define WEATHERRACK2_MAX_SUBSCRIPTIONS 8
+#define WEATHERRACK2_MAX_DEVICES 16
+#define WEATHERRACK2_LINK_TABLE_SIZE 16
+#define WEATHERRACK2_LINK_ALPHA 0.125        // weight of each new frame in the link averages
+#define WEATHERRACK2_LINK_BURST_GAP 2000     // ms between messages that starts a new burst
+#define WEATHERRACK2_COPIES_PER_BURST 1      // copies a sensor sends per burst, raised to the most seen
+#define WEATHERRACK2_BURST_WINDOW 100   // ms poll() keeps listening after a message for the rest of a burst
+
+// subscription filters
+#define WR2_MODEL_ANY 0
+#define WR2_MODEL_F016TH 5
+#define WR2_MODEL_FT020T 12
+#define WR2_DEVICE_ANY -1
+#define WR2_CHANNEL_ANY 0
+
+// One decoded and CRC verified sensor message
+
+struct WeatherRack2Reading {
+  long messageID;
+  uint8_t modelnumber;      // WR2_MODEL_F016TH or WR2_MODEL_FT020T
+  uint8_t device;
+  uint8_t channel;          // F016TH only (1-8), 0 for WeatherRack2
+  boolean batteryLow;
+  float temperature;        // C
+  uint8_t humidity;         // %
+  uint16_t avewindspeed;    // WeatherRack2 only from here down
+  uint16_t gustwindspeed;
+  uint16_t winddirection;
+  uint32_t cumulativerain;
+  uint32_t light;
+  uint16_t uv;
+  uint8_t CRC;
+};
+
+// RSSI like link quality of one sensor, from how the Manchester decoding went
+
+struct WeatherRack2LinkQuality {
+  uint8_t device;
+  uint8_t modelnumber;
+  uint8_t quality;          // 0-100 combining the three below
+  float timingVariance;     // us^2 of the transitions against the sample points (transitions found to a sample with WEATHERRACK2_OVERSAMPLE, coarse)
+  float copiesRatio;        // copies received / copies sent per burst, missed bursts counting as 0
+  float failureRate;        // complete frames failing the checksum
+  long framesGood;
+  long framesBad;
+  unsigned long lastSeen;   // millis()
+  uint8_t burstCopies;      // in the current burst
+  uint8_t copiesPerBurst;   // most copies seen in one burst
+  unsigned long burstStart;     // millis() of the first copy of the current burst
+  unsigned long burstInterval;  // ms, shortest seen between the starts of two bursts, 0 until then
+};
+
+typedef void (*WeatherRack2Callback)(const WeatherRack2Reading &reading);
+
 class SDL_ESP32_WeatherRack2 {
   public:
     SDL_ESP32_WeatherRack2(long timeout = WEATHERRACK2_TIMEOUT, boolean read_weatherrack2 = READ_WEATHERRACK2, boolean read_indoorth = READ_SDL_INDOOR_TH  );
 
 
     void begin(void);
+#ifdef WEATHERRACK2_NO_STRING
+    const char *getCurrentJSON();
+    const char *waitForNextJSON();
+#else
     String getCurrentJSON();
     String waitForNextJSON();
+#endif
     void setTimeout(long my_timeout);
+    void setDeadline(unsigned long my_deadline);
+    void setBitTimeout(unsigned long my_bittimeout);
+    void setYieldInterval(unsigned long my_yieldinterval);
+    unsigned long readWorstCaseMicros();
+    boolean allowDevice(uint8_t modelnumber, uint8_t device);
+    void clearAllowedDevices();
+    void setAutoLearn(boolean my_autolearn);
+    int readAllowedDevices(uint8_t *modelnumbers, uint8_t *devices, int size);
+    long readFramesRejected();
+    boolean readLinkQuality(uint8_t modelnumber, uint8_t device, WeatherRack2LinkQuality &quality);
+    int readLinkTable(WeatherRack2LinkQuality *table, int size);
+    int readLastFrame(uint8_t *frame, int size);
+    void dumpTrace(Print &out);
+    void clearTrace();
     void set_ReadWeatherRack2(boolean my_read_weatherrack2);
     void set_ReadIndoorth(boolean my_readindoorth);
     long readHeadersFound();
     long readWeatherRack2Found();
     long readSDLIndoorTHFound();
 
+    int poll(void);
+    int subscribe(WeatherRack2Callback callback, uint8_t modelnumber = WR2_MODEL_ANY, int device = WR2_DEVICE_ANY, uint8_t channel = WR2_CHANNEL_ANY);
+    void unsubscribe(int subscription);
+    boolean read(WeatherRack2Reading &reading);
+    int readQueued();
+    long readQueueDropped();
+    int toJSON(const WeatherRack2Reading &reading, char *json, int size);
+#ifndef WEATHERRACK2_NO_STRING
+    String toJSON(const WeatherRack2Reading &reading);
+#endif
+    long readHeapAllocationsLastMessage();
+    long readHeapAllocationsMax();
+    long readMinFreeHeap();
+#ifdef WEATHERRACK2_OVERSAMPLE
+    void feedSamples(const uint32_t *words, int count);
+    long readSampleOverruns();
+#endif
+
     long _timeout;
+    unsigned long _deadline;
+    unsigned long _bitTimeout;
+    unsigned long _yieldInterval;
+    boolean _autoLearn;
     boolean _read_weatherrack2;
     boolean _read_indoorth;
 
@@ -41,10 +183,15 @@ class SDL_ESP32_WeatherRack2 {
 
   private:
 
-    String findNextMessage();
-    String currentJSON;
-    String ErrorJSON;
-    String TimeOutJSON;
+    boolean findNextMessage(WeatherRack2Reading &reading, unsigned long timeout);
+    boolean processBit(byte bitState);
+#ifdef WEATHERRACK2_OVERSAMPLE
+    boolean decodeSamples();
+#endif
+    void startCall(unsigned long deadline);
+    void endCall();
+    boolean deadlinePassed();
+    char currentJSON[WEATHERRACK2_JSON_SIZE];
     long messageID;
 
 
@@ -52,15 +199,57 @@ class SDL_ESP32_WeatherRack2 {
     long FT300MessagesFound;
     long FT007MessagesFound;
 
+    struct Subscription {
+      WeatherRack2Callback callback;
+      uint8_t modelnumber;
+      int device;
+      uint8_t channel;
+    };
+
+    Subscription subscriptions[WEATHERRACK2_MAX_SUBSCRIPTIONS];
+    WeatherRack2Reading queue[WEATHERRACK2_QUEUE_SIZE];
+    uint8_t queueHead;
+    uint8_t queueCount;
+    long queueDropped;
+    WeatherRack2Reading decodedReading;
+
+    uint8_t allowedModels[WEATHERRACK2_MAX_DEVICES];
+    uint8_t allowedDevices[WEATHERRACK2_MAX_DEVICES];
+    uint8_t allowedCount;
+    long framesRejected;
+    uint8_t lastFrame[16];
+    uint8_t lastFrameLength;
+
+    WeatherRack2LinkQuality linkTable[WEATHERRACK2_LINK_TABLE_SIZE];
+
+    void updateLink(uint8_t modelnumber, uint8_t device, boolean good);
+    boolean deviceListed(uint8_t modelnumber, uint8_t device);
+    boolean deviceAllowed(uint8_t modelnumber, uint8_t device);
 
+    unsigned long callStart;
+    unsigned long callDeadline;
+    unsigned long worstCaseMicros;
 
+    long heapAllocationsLastMessage;
+    long heapAllocationsMax;
 
-    String add(byte bitData);
+    void queuePush(const WeatherRack2Reading &reading);
+    void dispatch(const WeatherRack2Reading &reading);
+
+
+
+    boolean add(byte bitData);
+#if WEATHERRACK2_DECODE_INDOORTH
     uint8_t Checksum(int length, uint8_t *buff);
+#endif
+#if WEATHERRACK2_DECODE_WEATHERRACK2
     uint8_t GetCRC(uint8_t crc, uint8_t * lpBuff, uint8_t ucLen);
-    String returnMessageJSON();
+#endif
+    void returnMessageJSON();
     void eraseManchester();
 
 
 
 };
+
+#endif
@@ -7,25 +7,63 @@
 */
 
 
+// #define WEATHERRACK2_BRIDGE   // send binary messages for extras/wr2bridged instead of text
+
 #include "SDL_ESP32_WeatherRack2.h"
+#ifdef WEATHERRACK2_BRIDGE
+#include "SDL_ESP32_WeatherRack2_Bridge.h"
+#endif
 
 SDL_ESP32_WeatherRack2 weatherRack2;
+#ifdef WEATHERRACK2_BRIDGE
+WeatherRack2Bridge bridge(Serial);
+#endif
+
 
+// called from poll() for every message received
+
+void printReading(const WeatherRack2Reading &reading)
+{
+#ifdef WEATHERRACK2_BRIDGE
+  bridge.sendReading(reading);
+  bridge.sendCounters(weatherRack2);
+  return;
+#endif
+
+  char json[WEATHERRACK2_JSON_SIZE];
+
+  weatherRack2.toJSON(reading, json, sizeof(json));
+  Serial.print("CurrentJSON=");
+  Serial.println(json);
+
+  Serial.print("Headers Found=");
+  Serial.println(weatherRack2.readHeadersFound());
+  Serial.print("WeatherRack2 Sensors Found=");
+  Serial.println(weatherRack2.readWeatherRack2Found());
+  Serial.print("Indoor T/H Found=");
+  Serial.println(weatherRack2.readSDLIndoorTHFound());
+  Serial.println();
+}
 
 
 
 void setup()
 {
   Serial.begin(115200);
+#ifndef WEATHERRACK2_BRIDGE
   Serial.println("-----------");
   Serial.println("SwitchDoc Labs");
   Serial.println("WeatherSense WeatherRack2 and Indoor T/H Test"); \
   Serial.println("-----------");
+#endif
 
   weatherRack2 = SDL_ESP32_WeatherRack2(600, true, true );
 
   weatherRack2.begin();
 
+  // every sensor; filter with e.g. subscribe(printReading, WR2_MODEL_F016TH, WR2_DEVICE_ANY, 4)
+  weatherRack2.subscribe(printReading);
+
 }
 
 
@@ -33,18 +71,7 @@ void setup()
 void loop()
 {
 
-  weatherRack2.waitForNextJSON();
-
-  Serial.print("CurrentJSON=");
-  Serial.println(weatherRack2.getCurrentJSON());
-
-  Serial.print("Headers Found=");
-  Serial.println(weatherRack2.readHeadersFound());
-  Serial.print("WeatherRack2 Sensors Found=");
-  Serial.println(weatherRack2.readWeatherRack2Found());
-  Serial.print("Indoor T/H Found=");
-  Serial.println(weatherRack2.readSDLIndoorTHFound());
-  Serial.println();
-  delay(5000);
+  // a few ms when no sensor is transmitting, otherwise the rest of the burst (up to setDeadline(), 500ms)
+  weatherRack2.poll();
 
 }
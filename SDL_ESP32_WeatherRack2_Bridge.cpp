@@ -0,0 +1,104 @@
+//
+//   SDL_ESP32_WeatherRack2 Library
+//   SDL_ESP32_WeatherRack2_Bridge.cpp
+//   Version 1.2
+//   SwitchDoc Labs   September 2020
+//
+//
+/*
+  Binary serial bridge to a host (see extras/wr2bridged for the Linux side).
+
+  A reading is 36 bytes on the wire against about 330 for the JSON, and the counters 28
+  against the three text lines, so at 115200 baud the link is never the bottleneck and the
+  host does not have to parse text.  Nothing is allocated - each message is built on the stack.
+*/
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "SDL_ESP32_WeatherRack2_Bridge.h"
+
+WeatherRack2Bridge::WeatherRack2Bridge(Stream &port) : _port(port)
+{
+  sequence = 0;
+}
+
+void WeatherRack2Bridge::sendReading(const WeatherRack2Reading &reading)
+{
+  struct wr2p_reading r;
+  uint8_t payload[WR2P_READING_SIZE];
+  float temperature = reading.temperature * 100.0;
+
+  r.messageid = reading.messageID;
+  r.modelnumber = reading.modelnumber;
+  r.device = reading.device;
+  r.channel = reading.channel;
+  r.flags = reading.batteryLow ? WR2P_FLAG_BATTERY_LOW : 0;
+  r.temperature = (int16_t)(temperature + (temperature < 0 ? -0.5 : 0.5));
+  r.humidity = reading.humidity;
+  r.avewindspeed = reading.avewindspeed;
+  r.gustwindspeed = reading.gustwindspeed;
+  r.winddirection = reading.winddirection;
+  r.cumulativerain = reading.cumulativerain;
+  r.light = reading.light;
+  r.uv = reading.uv;
+  r.crc = reading.CRC;
+
+  wr2p_pack_reading(&r, payload);
+  send(WR2P_READING, payload, sizeof(payload));
+}
+
+void WeatherRack2Bridge::sendCounters(SDL_ESP32_WeatherRack2 &receiver)
+{
+  struct wr2p_counters c;
+  uint8_t payload[WR2P_COUNTERS_SIZE];
+
+  c.headersfound = receiver.readHeadersFound();
+  c.weatherrack2found = receiver.readWeatherRack2Found();
+  c.indoorthfound = receiver.readSDLIndoorTHFound();
+  c.framesrejected = receiver.readFramesRejected();
+  c.queuedropped = receiver.readQueueDropped();
+
+  wr2p_pack_counters(&c, payload);
+  send(WR2P_COUNTERS, payload, sizeof(payload));
+}
+
+// The bytes of the last complete frame, good or bad
+
+void WeatherRack2Bridge::sendRawFrame(SDL_ESP32_WeatherRack2 &receiver)
+{
+  uint8_t payload[WR2P_MAX_PAYLOAD];
+  int length = receiver.readLastFrame(payload, sizeof(payload));
+
+  if (length > 0)
+    send(WR2P_RAW, payload, length);
+}
+
+uint16_t WeatherRack2Bridge::readSequence()
+{
+  return sequence;
+}
+
+//Internal functions
+
+void WeatherRack2Bridge::send(uint8_t type, const uint8_t *payload, int length)
+{
+  uint8_t message[WR2P_MAX_MESSAGE];
+  uint8_t encoded[WR2P_MAX_ENCODED];
+
+  message[0] = type;
+  wr2p_put16(message + 1, sequence);
+  memcpy(message + 3, payload, length);
+  wr2p_put16(message + 3 + length, wr2p_crc16(message, 3 + length));
+  sequence++;
+
+  // a delimiter first, so the host can separate the first message from the boot messages
+  if (sequence == 1)
+    _port.write((uint8_t)0);
+
+  int encodedLength = wr2p_cobs_encode(message, 3 + length + 2, encoded);
+  _port.write(encoded, encodedLength);
+}
@@ -0,0 +1,32 @@
+//
+//   SDL_ESP32_WeatherRack2_Bridge.h
+//   Version 1.2
+//   SwitchDoc Labs   September 2020
+//
+//   Sends readings to a host over serial in the binary protocol of SDL_ESP32_WeatherRack2_Protocol.h
+//
+
+#ifndef SDL_ESP32_WEATHERRACK2_BRIDGE_H
+#define SDL_ESP32_WEATHERRACK2_BRIDGE_H
+
+#include "SDL_ESP32_WeatherRack2.h"
+#include "SDL_ESP32_WeatherRack2_Protocol.h"
+
+class WeatherRack2Bridge {
+  public:
+    WeatherRack2Bridge(Stream &port);
+
+    void sendReading(const WeatherRack2Reading &reading);
+    void sendCounters(SDL_ESP32_WeatherRack2 &receiver);
+    void sendRawFrame(SDL_ESP32_WeatherRack2 &receiver);
+    uint16_t readSequence();
+
+  private:
+
+    Stream &_port;
+    uint16_t sequence;
+
+    void send(uint8_t type, const uint8_t *payload, int length);
+};
+
+#endif
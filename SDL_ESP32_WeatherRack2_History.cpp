@@ -0,0 +1,420 @@
+//
+//   SDL_ESP32_WeatherRack2 Library
+//   SDL_ESP32_WeatherRack2_History.cpp
+//   Version 1.2
+//   SwitchDoc Labs   September 2020
+//
+//
+/*
+  Keeps the history of every sensor field in RAM (PSRAM when the board has it) so local
+  dashboards can be answered without an upstream database.
+
+  Storage is a pool of fixed size blocks.  Each series (sensor + field) is a chain of blocks,
+  oldest first.  When the pool is full the oldest block of all is reused.
+
+  Inside a block samples are compressed much like Facebook's Gorilla:
+    time  - delta of delta, zigzag coded as   0 | 10 + 7 bits | 110 + 9 bits | 1110 + 12 bits | 1111 + 32 bits
+    value - delta, zigzag coded as            0 | 10 + 6 bits | 110 + 12 bits | 111 + 32 bits
+  Readings every minute with slowly changing values take 1-3 bytes a sample, so a week of
+  one minute data for 8 indoor channels and a WeatherRack2 fits in 570KB to 700KB, depending
+  on how noisy the values are (test/test_history.cpp).
+
+  Each block also keeps count/min/max/sum/last, so a query only decodes the blocks that
+  straddle the ends of its time range.
+
+*/
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#include "SDL_ESP32_WeatherRack2_History.h"
+
+#define MAX_SAMPLE_BITS (4 + 32 + 3 + 32)   // worst case time + value
+
+const uint8_t timeBucketSizes[] = {0, 7, 9, 12, 32};
+const uint8_t valueBucketSizes[] = {0, 6, 12, 32};
+
+WeatherRack2History::WeatherRack2History()
+{
+  blocks = NULL;
+  blockCount = 0;
+  freeList = -1;
+  samples = 0;
+
+  for (int i = 0; i < WR2_HISTORY_MAX_SERIES; i++)
+  {
+    series[i].head = -1;
+    series[i].tail = -1;
+  }
+}
+
+// Allocates the block pool, from PSRAM if the board has it.  The only allocation the store makes
+
+boolean WeatherRack2History::begin(uint32_t bytes)
+{
+  uint32_t count = bytes / sizeof(Block);
+
+  if (count > 32767)
+    count = 32767;
+
+#ifdef ESP32
+  if (psramFound())
+    blocks = (Block *)ps_malloc(count * sizeof(Block));
+  else
+    blocks = (Block *)malloc(count * sizeof(Block));
+#else
+  blocks = (Block *)malloc(count * sizeof(Block));
+#endif
+
+  if ((blocks == NULL) || (count == 0))
+    return false;
+
+  blockCount = count;
+  samples = 0;
+
+  for (int i = 0; i < WR2_HISTORY_MAX_SERIES; i++)
+  {
+    series[i].head = -1;
+    series[i].tail = -1;
+  }
+
+  freeList = -1;
+  for (int16_t i = blockCount - 1; i >= 0; i--)
+  {
+    blocks[i].next = freeList;
+    freeList = i;
+  }
+
+  return true;
+}
+
+// Stores every field of a reading.  time is whatever the application uses, e.g. seconds since 1970
+
+boolean WeatherRack2History::record(const WeatherRack2Reading &reading, uint32_t time)
+{
+  boolean stored;
+  int32_t temperature = (int32_t)(reading.temperature * 100.0 + (reading.temperature < 0 ? -0.5 : 0.5));
+
+  stored = append(reading.modelnumber, reading.device, reading.channel, WR2_FIELD_TEMPERATURE, time, temperature);
+  stored &= append(reading.modelnumber, reading.device, reading.channel, WR2_FIELD_HUMIDITY, time, reading.humidity);
+
+  if (reading.modelnumber == WR2_MODEL_FT020T)
+  {
+    stored &= append(reading.modelnumber, reading.device, reading.channel, WR2_FIELD_AVEWINDSPEED, time, reading.avewindspeed);
+    stored &= append(reading.modelnumber, reading.device, reading.channel, WR2_FIELD_GUSTWINDSPEED, time, reading.gustwindspeed);
+    stored &= append(reading.modelnumber, reading.device, reading.channel, WR2_FIELD_WINDDIRECTION, time, reading.winddirection);
+    stored &= append(reading.modelnumber, reading.device, reading.channel, WR2_FIELD_CUMULATIVERAIN, time, reading.cumulativerain);
+    stored &= append(reading.modelnumber, reading.device, reading.channel, WR2_FIELD_LIGHT, time, reading.light);
+    stored &= append(reading.modelnumber, reading.device, reading.channel, WR2_FIELD_UV, time, reading.uv);
+  }
+
+  return stored;
+}
+
+// Adds one sample.  Returns false if the series table is full or begin() has not been called
+
+boolean WeatherRack2History::append(uint8_t modelnumber, uint8_t device, uint8_t channel, uint8_t field, uint32_t time, int32_t value)
+{
+  int s = findSeries(modelnumber, device, channel, field, true);
+
+  if (s < 0)
+    return false;
+
+  Series &ser = series[s];
+
+  if ((ser.tail < 0) || (blocks[ser.tail].bits + MAX_SAMPLE_BITS > WR2_HISTORY_BLOCK_BYTES * 8) || (blocks[ser.tail].count == 0xFFFF))
+  {
+    int16_t b = allocateBlock();   // may reuse the oldest block of this very series
+
+    if (b < 0)
+      return false;
+
+    Block &block = blocks[b];
+    block.next = -1;
+    block.series = s;
+    block.count = 1;
+    block.bits = 0;
+    block.minTime = time;
+    block.maxTime = time;
+    block.firstTime = time;
+    block.lastTime = time;
+    block.lastDelta = 0;
+    block.firstValue = value;
+    block.lastValue = value;
+    block.min = value;
+    block.max = value;
+    block.sum = value;
+    memset(block.data, 0, sizeof(block.data));
+
+    ser.modelnumber = modelnumber;
+    ser.device = device;
+    ser.channel = channel;
+    ser.field = field;
+    if (ser.tail >= 0)
+      blocks[ser.tail].next = b;
+    else
+      ser.head = b;
+    ser.tail = b;
+
+    samples++;
+    return true;
+  }
+
+  Block &block = blocks[ser.tail];
+
+  int32_t delta = (int32_t)(time - block.lastTime);
+  writeZigZag(block, delta - block.lastDelta, timeBucketSizes, sizeof(timeBucketSizes));
+  writeZigZag(block, value - block.lastValue, valueBucketSizes, sizeof(valueBucketSizes));
+
+  block.lastDelta = delta;
+  block.lastTime = time;
+  block.lastValue = value;
+  block.count++;
+  block.sum += value;
+  if (time < block.minTime)
+    block.minTime = time;
+  if (time > block.maxTime)
+    block.maxTime = time;
+  if (value < block.min)
+    block.min = value;
+  if (value > block.max)
+    block.max = value;
+
+  samples++;
+  return true;
+}
+
+// min/max/mean/last of field from time from to to (inclusive) across every series matching the
+// filters.  Returns false if there are no samples in the range
+
+boolean WeatherRack2History::query(uint8_t field, uint32_t from, uint32_t to, WeatherRack2HistoryStats &stats,
+                                   uint8_t modelnumber, int device, uint8_t channel)
+{
+  int64_t sum = 0;
+
+  memset(&stats, 0, sizeof(stats));
+  stats.min = INT32_MAX;
+  stats.max = INT32_MIN;
+
+  for (int s = 0; s < WR2_HISTORY_MAX_SERIES; s++)
+  {
+    Series &ser = series[s];
+
+    if ((ser.head < 0) || (ser.field != field))
+      continue;
+    if ((modelnumber != WR2_MODEL_ANY) && (modelnumber != ser.modelnumber))
+      continue;
+    if ((device != WR2_DEVICE_ANY) && (device != ser.device))
+      continue;
+    if ((channel != WR2_CHANNEL_ANY) && (channel != ser.channel))
+      continue;
+
+    for (int16_t b = ser.head; b >= 0; b = blocks[b].next)
+    {
+      const Block &block = blocks[b];
+
+      if ((block.maxTime < from) || (block.minTime > to))
+        continue;
+
+      if ((block.minTime >= from) && (block.maxTime <= to))
+      {
+        // wholly inside the range, the summary will do
+        if ((stats.count == 0) || (block.lastTime >= stats.lastTime))
+        {
+          stats.last = block.lastValue;
+          stats.lastTime = block.lastTime;
+        }
+        stats.count += block.count;
+        sum += block.sum;
+        if (block.min < stats.min)
+          stats.min = block.min;
+        if (block.max > stats.max)
+          stats.max = block.max;
+        continue;
+      }
+
+      uint32_t time = block.firstTime;
+      int32_t value = block.firstValue;
+      int32_t delta = 0;
+      uint16_t position = 0;
+
+      if ((time >= from) && (time <= to))
+        addSample(stats, time, value, sum);
+
+      for (uint16_t i = 1; i < block.count; i++)
+      {
+        delta += readZigZag(block, position, timeBucketSizes, sizeof(timeBucketSizes));
+        time += delta;
+        value += readZigZag(block, position, valueBucketSizes, sizeof(valueBucketSizes));
+
+        if ((time >= from) && (time <= to))
+          addSample(stats, time, value, sum);
+      }
+    }
+  }
+
+  if (stats.count == 0)
+    return false;
+
+  stats.mean = (float)sum / stats.count;
+  return true;
+}
+
+uint32_t WeatherRack2History::readSamples()
+{
+  return samples;
+}
+
+uint32_t WeatherRack2History::readBlocks()
+{
+  uint32_t used = 0;
+
+  for (int s = 0; s < WR2_HISTORY_MAX_SERIES; s++)
+  {
+    for (int16_t b = series[s].head; b >= 0; b = blocks[b].next)
+    {
+      used++;
+    }
+  }
+  return used;
+}
+
+uint32_t WeatherRack2History::readBytesUsed()
+{
+  return readBlocks() * sizeof(Block);
+}
+
+//Internal functions
+
+int WeatherRack2History::findSeries(uint8_t modelnumber, uint8_t device, uint8_t channel, uint8_t field, boolean create)
+{
+  int freeSlot = -1;
+
+  for (int s = 0; s < WR2_HISTORY_MAX_SERIES; s++)
+  {
+    Series &ser = series[s];
+
+    if (ser.head < 0)
+    {
+      if (freeSlot < 0)
+        freeSlot = s;
+      continue;
+    }
+
+    if ((ser.modelnumber == modelnumber) && (ser.device == device) && (ser.channel == channel) && (ser.field == field))
+      return s;
+  }
+
+  if (!create)
+    return -1;
+  return freeSlot;
+}
+
+// Takes a free block, or when the pool is full the oldest block of any series
+
+int16_t WeatherRack2History::allocateBlock()
+{
+  if (freeList >= 0)
+  {
+    int16_t b = freeList;
+    freeList = blocks[b].next;
+    return b;
+  }
+
+  int oldest = -1;
+
+  for (int s = 0; s < WR2_HISTORY_MAX_SERIES; s++)
+  {
+    if (series[s].head < 0)
+      continue;
+
+    if ((oldest < 0) || (blocks[series[s].head].firstTime < blocks[series[oldest].head].firstTime))
+      oldest = s;
+  }
+
+  if (oldest < 0)
+    return -1;
+
+  Series &ser = series[oldest];
+  int16_t b = ser.head;
+
+  ser.head = blocks[b].next;
+  if (ser.head < 0)
+    ser.tail = -1;
+  samples -= blocks[b].count;
+  return b;
+}
+
+void WeatherRack2History::writeBits(Block &block, uint32_t value, uint8_t bits)
+{
+  while (bits > 0)
+  {
+    bits--;
+    if ((value >> bits) & 1)
+      block.data[block.bits >> 3] |= 0x80 >> (block.bits & 7);
+    block.bits++;
+  }
+}
+
+uint32_t WeatherRack2History::readBits(const Block &block, uint16_t &position, uint8_t bits)
+{
+  uint32_t value = 0;
+
+  while (bits > 0)
+  {
+    bits--;
+    value = (value << 1) | ((block.data[position >> 3] >> (7 - (position & 7))) & 1);
+    position++;
+  }
+  return value;
+}
+
+// Bucket i is written as i ones, a zero (except for the last bucket), then sizes[i] bits
+
+void WeatherRack2History::writeZigZag(Block &block, int32_t value, const uint8_t *sizes, uint8_t buckets)
+{
+  uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+  uint8_t i;
+
+  for (i = 0; i < buckets - 1; i++)
+  {
+    if (zigzag < (1UL << sizes[i]))
+      break;
+  }
+
+  writeBits(block, (1UL << i) - 1, i);
+  if (i < buckets - 1)
+    writeBits(block, 0, 1);
+  writeBits(block, zigzag, sizes[i]);
+}
+
+int32_t WeatherRack2History::readZigZag(const Block &block, uint16_t &position, const uint8_t *sizes, uint8_t buckets)
+{
+  uint8_t i = 0;
+
+  while ((i < buckets - 1) && readBits(block, position, 1))
+  {
+    i++;
+  }
+
+  uint32_t zigzag = readBits(block, position, sizes[i]);
+  return (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+}
+
+void WeatherRack2History::addSample(WeatherRack2HistoryStats &stats, uint32_t time, int32_t value, int64_t &sum)
+{
+  if ((stats.count == 0) || (time >= stats.lastTime))
+  {
+    stats.last = value;
+    stats.lastTime = time;
+  }
+  stats.count++;
+  sum += value;
+  if (value < stats.min)
+    stats.min = value;
+  if (value > stats.max)
+    stats.max = value;
+}
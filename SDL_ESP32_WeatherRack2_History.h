@@ -0,0 +1,98 @@
+//
+//   SDL_ESP32_WeatherRack2_History.h
+//   Version 1.2
+//   SwitchDoc Labs   September 2020
+//
+//   Compressed time series store for WeatherRack2Readings
+//
+
+#ifndef SDL_ESP32_WEATHERRACK2_HISTORY_H
+#define SDL_ESP32_WEATHERRACK2_HISTORY_H
+
+#include "SDL_ESP32_WeatherRack2.h"
+
+#define WR2_HISTORY_BLOCK_BYTES 128   // compressed samples per block
+#define WR2_HISTORY_MAX_SERIES 48     // one series per sensor and field
+
+// fields, values are stored as integers in these units
+#define WR2_FIELD_TEMPERATURE 0       // C * 100
+#define WR2_FIELD_HUMIDITY 1          // %
+#define WR2_FIELD_AVEWINDSPEED 2      // as in the JSON from here down (WeatherRack2 only)
+#define WR2_FIELD_GUSTWINDSPEED 3
+#define WR2_FIELD_WINDDIRECTION 4
+#define WR2_FIELD_CUMULATIVERAIN 5
+#define WR2_FIELD_LIGHT 6
+#define WR2_FIELD_UV 7
+#define WR2_FIELD_COUNT 8
+
+struct WeatherRack2HistoryStats {
+  uint32_t count;
+  int32_t min;
+  int32_t max;
+  float mean;
+  int32_t last;
+  uint32_t lastTime;
+};
+
+class WeatherRack2History {
+  public:
+    WeatherRack2History();
+
+    boolean begin(uint32_t bytes);
+    boolean record(const WeatherRack2Reading &reading, uint32_t time);
+    boolean append(uint8_t modelnumber, uint8_t device, uint8_t channel, uint8_t field, uint32_t time, int32_t value);
+    boolean query(uint8_t field, uint32_t from, uint32_t to, WeatherRack2HistoryStats &stats,
+                  uint8_t modelnumber = WR2_MODEL_ANY, int device = WR2_DEVICE_ANY, uint8_t channel = WR2_CHANNEL_ANY);
+    uint32_t readSamples();
+    uint32_t readBytesUsed();
+    uint32_t readBlocks();
+
+  private:
+
+    // Each block starts with a raw sample, then every further sample is a delta of delta
+    // time and a delta value, both zigzag coded into variable length bit fields.
+    // The summary lets queries skip decoding blocks that lie wholly inside the range
+
+    struct Block {
+      int16_t next;             // next (newer) block of the series, -1 at the end
+      uint8_t series;
+      uint16_t count;
+      uint16_t bits;            // used in data
+      uint32_t minTime;
+      uint32_t maxTime;
+      uint32_t firstTime;
+      uint32_t lastTime;
+      int32_t lastDelta;
+      int32_t firstValue;
+      int32_t lastValue;
+      int32_t min;
+      int32_t max;
+      int64_t sum;
+      uint8_t data[WR2_HISTORY_BLOCK_BYTES];
+    };
+
+    struct Series {
+      uint8_t modelnumber;
+      uint8_t device;
+      uint8_t channel;
+      uint8_t field;
+      int16_t head;             // oldest block, -1 if the slot is free
+      int16_t tail;
+    };
+
+    Block *blocks;
+    int16_t blockCount;
+    int16_t freeList;
+    uint32_t samples;
+    Series series[WR2_HISTORY_MAX_SERIES];
+
+    int findSeries(uint8_t modelnumber, uint8_t device, uint8_t channel, uint8_t field, boolean create);
+    int16_t allocateBlock();
+    void writeBits(Block &block, uint32_t value, uint8_t bits);
+    uint32_t readBits(const Block &block, uint16_t &position, uint8_t bits);
+    void writeZigZag(Block &block, int32_t value, const uint8_t *sizes, uint8_t buckets);
+    int32_t readZigZag(const Block &block, uint16_t &position, const uint8_t *sizes, uint8_t buckets);
+    void addSample(WeatherRack2HistoryStats &stats, uint32_t time, int32_t value, int64_t &sum);
+};
+
+#endif
@@ -0,0 +1,227 @@
+//
+//   SDL_ESP32_WeatherRack2_Protocol.h
+//   Version 1.2
+//   SwitchDoc Labs   September 2020
+//
+//   Binary serial bridge protocol, shared by the ESP32 (SDL_ESP32_WeatherRack2_Bridge)
+//   and the Linux daemon (extras/wr2bridged).  Plain C so both can include it.
+//
+/*
+  Each message is
+
+    type (1)  sequence (2)  payload (0-WR2P_MAX_PAYLOAD)  CRC-16/CCITT-FALSE of all before it (2)
+
+  COBS encoded and ended with a 0x00, so a receiver can always find the start of the next
+  message after noise or a reset.  Multi byte fields are little endian.  The sequence number
+  counts every message sent, so the host can see how many it has lost.
+
+  WR2P_READING payload (28 bytes)
+    messageid u32, modelnumber u8, device u8, channel u8, flags u8 (bit 0 battery low),
+    temperature i16 (C * 100), humidity u8, avewindspeed u16, gustwindspeed u16,
+    winddirection u16, cumulativerain u32, light u32, uv u16, CRC u8
+
+  WR2P_COUNTERS payload (20 bytes)
+    headersfound u32, weatherrack2found u32, indoorthfound u32, framesrejected u32, queuedropped u32
+
+  WR2P_RAW payload
+    the frame bytes as received (manchester[]), 7 for an F016TH, 16 for a WeatherRack2
+*/
+
+#ifndef SDL_ESP32_WEATHERRACK2_PROTOCOL_H
+#define SDL_ESP32_WEATHERRACK2_PROTOCOL_H
+
+#include <stdint.h>
+
+#define WR2P_READING 0x01
+#define WR2P_COUNTERS 0x02
+#define WR2P_RAW 0x03
+
+#define WR2P_READING_SIZE 28
+#define WR2P_COUNTERS_SIZE 20
+#define WR2P_MAX_PAYLOAD 32
+#define WR2P_MAX_MESSAGE (1 + 2 + WR2P_MAX_PAYLOAD + 2)
+#define WR2P_MAX_ENCODED (WR2P_MAX_MESSAGE + WR2P_MAX_MESSAGE / 254 + 2)   // COBS + the 0x00
+
+#define WR2P_FLAG_BATTERY_LOW 0x01
+
+struct wr2p_reading {
+  uint32_t messageid;
+  uint8_t modelnumber;
+  uint8_t device;
+  uint8_t channel;
+  uint8_t flags;
+  int16_t temperature;
+  uint8_t humidity;
+  uint16_t avewindspeed;
+  uint16_t gustwindspeed;
+  uint16_t winddirection;
+  uint32_t cumulativerain;
+  uint32_t light;
+  uint16_t uv;
+  uint8_t crc;
+};
+
+struct wr2p_counters {
+  uint32_t headersfound;
+  uint32_t weatherrack2found;
+  uint32_t indoorthfound;
+  uint32_t framesrejected;
+  uint32_t queuedropped;
+};
+
+static inline uint16_t wr2p_crc16(const uint8_t *data, int length)
+{
+  uint16_t crc = 0xFFFF;
+
+  while (length--)
+  {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (int i = 0; i < 8; i++)
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+  }
+  return crc;
+}
+
+static inline void wr2p_put16(uint8_t *p, uint16_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static inline void wr2p_put32(uint8_t *p, uint32_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static inline uint16_t wr2p_get16(const uint8_t *p)
+{
+  return p[0] | ((uint16_t)p[1] << 8);
+}
+
+static inline uint32_t wr2p_get32(const uint8_t *p)
+{
+  return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// COBS encodes length bytes of src into dst and adds the 0x00 delimiter.  Returns the bytes written
+
+static inline int wr2p_cobs_encode(const uint8_t *src, int length, uint8_t *dst)
+{
+  int code = 0;       // where the current block's length byte goes
+  int out = 1;
+  uint8_t run = 1;
+
+  for (int i = 0; i < length; i++)
+  {
+    if (src[i] == 0)
+    {
+      dst[code] = run;
+      code = out++;
+      run = 1;
+      continue;
+    }
+
+    dst[out++] = src[i];
+    run++;
+    if (run == 0xFF)
+    {
+      dst[code] = run;
+      code = out++;
+      run = 1;
+    }
+  }
+
+  dst[code] = run;
+  dst[out++] = 0;
+  return out;
+}
+
+// Decodes one COBS block (without the 0x00) into dst.  Returns the length, or -1 if it is malformed
+
+static inline int wr2p_cobs_decode(const uint8_t *src, int length, uint8_t *dst, int size)
+{
+  int in = 0;
+  int out = 0;
+
+  while (in < length)
+  {
+    uint8_t code = src[in++];
+
+    if ((code == 0) || (in + code - 1 > length))
+      return -1;
+
+    for (int i = 1; i < code; i++)
+    {
+      if (out >= size)
+        return -1;
+      dst[out++] = src[in++];
+    }
+
+    if ((code != 0xFF) && (in < length))
+    {
+      if (out >= size)
+        return -1;
+      dst[out++] = 0;
+    }
+  }
+  return out;
+}
+
+static inline void wr2p_pack_reading(const struct wr2p_reading *r, uint8_t *p)
+{
+  wr2p_put32(p, r->messageid);
+  p[4] = r->modelnumber;
+  p[5] = r->device;
+  p[6] = r->channel;
+  p[7] = r->flags;
+  wr2p_put16(p + 8, (uint16_t)r->temperature);
+  p[10] = r->humidity;
+  wr2p_put16(p + 11, r->avewindspeed);
+  wr2p_put16(p + 13, r->gustwindspeed);
+  wr2p_put16(p + 15, r->winddirection);
+  wr2p_put32(p + 17, r->cumulativerain);
+  wr2p_put32(p + 21, r->light);
+  wr2p_put16(p + 25, r->uv);
+  p[27] = r->crc;
+}
+
+static inline void wr2p_unpack_reading(const uint8_t *p, struct wr2p_reading *r)
+{
+  r->messageid = wr2p_get32(p);
+  r->modelnumber = p[4];
+  r->device = p[5];
+  r->channel = p[6];
+  r->flags = p[7];
+  r->temperature = (int16_t)wr2p_get16(p + 8);
+  r->humidity = p[10];
+  r->avewindspeed = wr2p_get16(p + 11);
+  r->gustwindspeed = wr2p_get16(p + 13);
+  r->winddirection = wr2p_get16(p + 15);
+  r->cumulativerain = wr2p_get32(p + 17);
+  r->light = wr2p_get32(p + 21);
+  r->uv = wr2p_get16(p + 25);
+  r->crc = p[27];
+}
+
+static inline void wr2p_pack_counters(const struct wr2p_counters *c, uint8_t *p)
+{
+  wr2p_put32(p, c->headersfound);
+  wr2p_put32(p + 4, c->weatherrack2found);
+  wr2p_put32(p + 8, c->indoorthfound);
+  wr2p_put32(p + 12, c->framesrejected);
+  wr2p_put32(p + 16, c->queuedropped);
+}
+
+static inline void wr2p_unpack_counters(const uint8_t *p, struct wr2p_counters *c)
+{
+  c->headersfound = wr2p_get32(p);
+  c->weatherrack2found = wr2p_get32(p + 4);
+  c->indoorthfound = wr2p_get32(p + 8);
+  c->framesrejected = wr2p_get32(p + 12);
+  c->queuedropped = wr2p_get32(p + 16);
+}
+
+#endif
@@ -0,0 +1,344 @@
+/*
+  wr2bridged - WeatherRack2 serial bridge daemon for Linux
+  SwitchDoc Labs   September 2020
+
+  Reads the binary protocol (SDL_ESP32_WeatherRack2_Protocol.h) from the ESP32's serial port,
+  checks it and hands every message, as one line of JSON, to each program connected to a
+  Unix domain socket (and to stdout with -v).
+
+    cc -O2 -Wall -o wr2bridged wr2bridged.c
+    ./wr2bridged [-b baud] [-s socket] [-v] /dev/ttyUSB0
+    socat - UNIX-CONNECT:/tmp/wr2bridged.sock
+
+  Consumers that fall behind are disconnected rather than allowed to stall the others.
+*/
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "../../SDL_ESP32_WeatherRack2_Protocol.h"
+
+#define MAX_CLIENTS 16
+#define LINE_SIZE 512
+
+static volatile sig_atomic_t running = 1;
+
+static int clients[MAX_CLIENTS];
+static int clientCount = 0;
+static int verbose = 0;
+
+static unsigned long messages = 0;
+static unsigned long badMessages = 0;
+static unsigned long lostMessages = 0;
+static unsigned long restarts = 0;
+static int haveSequence = 0;
+static uint16_t expectedSequence = 0;
+
+static void stop(int sig)
+{
+  (void)sig;
+  running = 0;
+}
+
+static speed_t baudRate(long baud)
+{
+  switch (baud)
+  {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default: return B115200;
+  }
+}
+
+// Raw mode at baud.  A pty is a tty too, so the same path works for testing
+
+static int openPort(const char *path, long baud)
+{
+  struct termios tio;
+  int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+  if (fd < 0)
+    return -1;
+
+  if (tcgetattr(fd, &tio) == 0)
+  {
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baudRate(baud));
+    cfsetospeed(&tio, baudRate(baud));
+    tio.c_cflag |= CLOCAL | CREAD;
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  return fd;
+}
+
+static int openSocket(const char *path)
+{
+  struct sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+  if (fd < 0)
+    return -1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  unlink(path);
+
+  if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(fd, MAX_CLIENTS) < 0))
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void dropClient(int i)
+{
+  close(clients[i]);
+  clients[i] = clients[--clientCount];
+}
+
+static void publish(const char *line)
+{
+  int length = strlen(line);
+
+  if (verbose)
+  {
+    fputs(line, stdout);
+    fflush(stdout);
+  }
+
+  for (int i = clientCount - 1; i >= 0; i--)
+  {
+    if (send(clients[i], line, length, MSG_NOSIGNAL | MSG_DONTWAIT) != length)
+      dropClient(i);
+  }
+}
+
+static void formatReading(const uint8_t *payload, uint16_t sequence, char *line)
+{
+  struct wr2p_reading r;
+  const char *battery;
+
+  wr2p_unpack_reading(payload, &r);
+  battery = (r.flags & WR2P_FLAG_BATTERY_LOW) ? "LOW" : "OK";
+
+  if (r.modelnumber == 5)
+  {
+    snprintf(line, LINE_SIZE,
+             "{\"type\":\"reading\",\"seq\":%u,\"messageid\":%u,\"model\":\"SwitchDoc Labs F016TH Thermo-Hygrometer\","
+             "\"device\":%u,\"modelnumber\":5,\"channel\":%u,\"battery\":\"%s\",\"temperature\":%.2f,\"humidity\":%u,"
+             "\"CRC\":\"%x\"}\n",
+             sequence, r.messageid, r.device, r.channel, battery, r.temperature / 100.0, r.humidity, r.crc);
+    return;
+  }
+
+  snprintf(line, LINE_SIZE,
+           "{\"type\":\"reading\",\"seq\":%u,\"messageid\":%u,\"model\":\"SwitchDoc Labs FT020T AIO\","
+           "\"device\":%u,\"modelnumber\":%u,\"battery\":\"%s\",\"avewindspeed\":%u,\"gustwindspeed\":%u,"
+           "\"winddirection\":%u,\"cumulativerain\":%u,\"temperature\":%.2f,\"humidity\":%u,\"light\":%u,"
+           "\"uv\":%u,\"CRC\":\"%x\"}\n",
+           sequence, r.messageid, r.device, r.modelnumber, battery, r.avewindspeed, r.gustwindspeed,
+           r.winddirection, r.cumulativerain, r.temperature / 100.0, r.humidity, r.light, r.uv, r.crc);
+}
+
+static void formatCounters(const uint8_t *payload, uint16_t sequence, char *line)
+{
+  struct wr2p_counters c;
+
+  wr2p_unpack_counters(payload, &c);
+  snprintf(line, LINE_SIZE,
+           "{\"type\":\"counters\",\"seq\":%u,\"headersfound\":%u,\"weatherrack2found\":%u,\"indoorthfound\":%u,"
+           "\"framesrejected\":%u,\"queuedropped\":%u,\"bridgebad\":%lu,\"bridgelost\":%lu}\n",
+           sequence, c.headersfound, c.weatherrack2found, c.indoorthfound, c.framesrejected, c.queuedropped,
+           badMessages, lostMessages);
+}
+
+static void formatRaw(const uint8_t *payload, int length, uint16_t sequence, char *line)
+{
+  int n = snprintf(line, LINE_SIZE, "{\"type\":\"raw\",\"seq\":%u,\"bytes\":\"", sequence);
+
+  for (int i = 0; i < length; i++)
+    n += snprintf(line + n, LINE_SIZE - n, "%02X", payload[i]);
+  snprintf(line + n, LINE_SIZE - n, "\"}\n");
+}
+
+// One COBS block from between two 0x00s
+
+static void handleMessage(const uint8_t *encoded, int encodedLength)
+{
+  uint8_t message[WR2P_MAX_MESSAGE];
+  char line[LINE_SIZE];
+  int length = wr2p_cobs_decode(encoded, encodedLength, message, sizeof(message));
+
+  if ((length < 5) || (wr2p_crc16(message, length - 2) != wr2p_get16(message + length - 2)))
+  {
+    badMessages++;
+    return;
+  }
+
+  uint8_t type = message[0];
+  uint16_t sequence = wr2p_get16(message + 1);
+  const uint8_t *payload = message + 3;
+  int payloadLength = length - 5;
+
+  if (haveSequence && (sequence != expectedSequence))
+  {
+    uint16_t gap = sequence - expectedSequence;
+
+    // the ESP32 starts again from 0 when it resets, which is not a gap
+    if ((sequence == 0) || (gap >= 0x8000))
+    {
+      restarts++;
+      snprintf(line, LINE_SIZE, "{\"type\":\"restart\",\"seq\":%u,\"expected\":%u}\n", sequence, expectedSequence);
+      publish(line);
+    }
+    else
+      lostMessages += gap;
+  }
+  haveSequence = 1;
+  expectedSequence = sequence + 1;
+  messages++;
+
+  if ((type == WR2P_READING) && (payloadLength == WR2P_READING_SIZE))
+    formatReading(payload, sequence, line);
+  else if ((type == WR2P_COUNTERS) && (payloadLength == WR2P_COUNTERS_SIZE))
+    formatCounters(payload, sequence, line);
+  else if (type == WR2P_RAW)
+    formatRaw(payload, payloadLength, sequence, line);
+  else
+  {
+    badMessages++;
+    return;
+  }
+
+  publish(line);
+}
+
+int main(int argc, char **argv)
+{
+  const char *socketPath = "/tmp/wr2bridged.sock";
+  long baud = 115200;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "b:s:v")) != -1)
+  {
+    switch (opt)
+    {
+      case 'b': baud = atol(optarg); break;
+      case 's': socketPath = optarg; break;
+      case 'v': verbose = 1; break;
+      default:
+        fprintf(stderr, "usage: %s [-b baud] [-s socket] [-v] device\n", argv[0]);
+        return 2;
+    }
+  }
+
+  if (optind >= argc)
+  {
+    fprintf(stderr, "usage: %s [-b baud] [-s socket] [-v] device\n", argv[0]);
+    return 2;
+  }
+
+  int port = openPort(argv[optind], baud);
+  if (port < 0)
+  {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  int listener = openSocket(socketPath);
+  if (listener < 0)
+  {
+    perror(socketPath);
+    return 1;
+  }
+
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+
+  uint8_t frame[WR2P_MAX_ENCODED];
+  int frameLength = 0;
+  int overflow = 0;
+
+  while (running)
+  {
+    struct pollfd fds[2];
+
+    fds[0].fd = port;
+    fds[0].events = POLLIN;
+    fds[1].fd = listener;
+    fds[1].events = POLLIN;
+
+    if (poll(fds, 2, 1000) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      perror("poll");
+      break;
+    }
+
+    if (fds[1].revents & POLLIN)
+    {
+      int client = accept(listener, NULL, NULL);
+
+      if ((client >= 0) && (clientCount < MAX_CLIENTS))
+        clients[clientCount++] = client;
+      else if (client >= 0)
+        close(client);
+    }
+
+    if (fds[0].revents & (POLLHUP | POLLERR))
+    {
+      fprintf(stderr, "%s: port closed\n", argv[optind]);
+      break;
+    }
+
+    if (fds[0].revents & POLLIN)
+    {
+      uint8_t buffer[256];
+      ssize_t n = read(port, buffer, sizeof(buffer));
+
+      for (ssize_t i = 0; i < n; i++)
+      {
+        if (buffer[i] == 0)
+        {
+          // text before the first message, or a block too long, is counted once as bad
+          if (overflow || (frameLength > 0))
+            handleMessage(frame, overflow ? 0 : frameLength);
+          frameLength = 0;
+          overflow = 0;
+        }
+        else if (frameLength < (int)sizeof(frame))
+          frame[frameLength++] = buffer[i];
+        else
+          overflow = 1;
+      }
+    }
+  }
+
+  for (int i = 0; i < clientCount; i++)
+    close(clients[i]);
+  close(listener);
+  unlink(socketPath);
+  close(port);
+
+  fprintf(stderr, "wr2bridged: %lu messages, %lu bad, %lu lost, %lu restarts\n", messages, badMessages, lostMessages, restarts);
+  return 0;
+}
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+#
+#   wr2trace.py
+#   SwitchDoc Labs   September 2020
+#
+#   Renders the decoder trace written by SDL_ESP32_WeatherRack2::dumpTrace() as a timeline.
+#
+#     python3 wr2trace.py serial.log        (or pipe the serial output in)
+#     python3 wr2trace.py -v serial.log     every bit on its own line
+#
+#   Anything in the log outside the WR2TRACE ... WR2TRACE END block is ignored.
+#
+
+import argparse
+import math
+import sys
+
+HEADER, BIT, ERROR, FRAME, RESULT = 1, 2, 3, 4, 5
+
+ERRORS = {1: "transition early", 2: "no transition (bit timeout / deadline)"}
+RESULTS = {0: "BAD checksum", 1: "GOOD", 2: "rejected type", 3: "rejected device"}
+TYPES = {0x45: "F016TH", 0x4C: "FT020T"}
+
+
+def read_trace(lines):
+    """Returns (cycles per us, [(cycles, type, a, b)]) for the last trace in the log"""
+    trace = None
+    events = []
+    for line in lines:
+        fields = line.split()
+        if len(fields) == 3 and fields[0] == "WR2TRACE":
+            trace = int(fields[1])
+            events = []
+        elif fields == ["WR2TRACE", "END"]:
+            if trace is not None:
+                return trace, events
+        elif trace is not None and len(fields) == 4:
+            try:
+                events.append((int(fields[0], 16), int(fields[1]), int(fields[2]), int(fields[3])))
+            except ValueError:
+                pass
+    if trace is None:
+        sys.exit("no WR2TRACE block found")
+    return trace, events
+
+
+def describe(kind, a, b):
+    if kind == HEADER:
+        return "header     %d ones" % a
+    if kind == ERROR:
+        return "error      %s after %d bytes" % (ERRORS.get(a, a), b)
+    if kind == FRAME:
+        return "frame      %d bytes, type %02X %s" % (a, b, TYPES.get(b, ""))
+    if kind == RESULT:
+        what = "type %02X" % b if a == 2 else "device %d" % b
+        return "result     %s, %s" % (RESULTS.get(a, a), what)
+    return "event %d   %d %d" % (kind, a, b)
+
+
+def bits_line(bits):
+    waits = [b for _, b in bits]
+    mean = sum(waits) / len(waits)
+    sd = math.sqrt(sum((w - mean) ** 2 for w in waits) / len(waits))
+    pattern = "".join(str(a & 1) for a, _ in bits)
+    pattern = " ".join(pattern[i:i + 8] for i in range(0, len(pattern), 8))
+    return "bits       %d: %s  (transition wait %.0f us, sd %.0f, max %d)" % (len(bits), pattern, mean, sd, max(waits))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("-v", "--verbose", action="store_true", help="show every bit")
+    parser.add_argument("log", nargs="?", type=argparse.FileType("r"), default=sys.stdin)
+    args = parser.parse_args()
+
+    per_us, events = read_trace(args.log)
+    if not events:
+        print("trace is empty")
+        return
+
+    print("%12s %10s  event" % ("time us", "+us"))
+
+    time = 0.0
+    last_print = 0.0
+    previous = events[0][0]
+    bits = []
+    bits_start = 0.0
+
+    def show(at, text):
+        nonlocal last_print
+        print("%12.1f %10.1f  %s" % (at, at - last_print, text))
+        last_print = at
+
+    for cycles, kind, a, b in events:
+        time += ((cycles - previous) & 0xFFFFFFFF) / per_us   # the cycle counter wraps
+        previous = cycles
+
+        if kind == BIT and not args.verbose:
+            if not bits:
+                bits_start = time
+            bits.append((a, b))
+            continue
+
+        if bits:
+            show(bits_start, bits_line(bits))
+            bits = []
+
+        if kind == BIT:
+            show(time, "bit        %d  (transition wait %d us)" % (a & 1, b))
+        else:
+            show(time, describe(kind, a, b))
+
+    if bits:
+        show(bits_start, bits_line(bits))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,40 @@
+#include "Arduino.h"
+
+static unsigned long now = 0;
+static const unsigned long *waveTimes = NULL;
+static const uint8_t *waveLevels = NULL;
+static int waveCount = 0;
+
+void setWaveform(const unsigned long *times, const uint8_t *levels, int count)
+{
+  waveTimes = times;
+  waveLevels = levels;
+  waveCount = count;
+}
+
+int levelAt(unsigned long time)
+{
+  int low = 0;
+  int high = waveCount;
+
+  // last change at or before time
+  while (low < high)
+  {
+    int middle = (low + high) / 2;
+    if (waveTimes[middle] <= time)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return (low == 0) ? 0 : waveLevels[low - 1];
+}
+
+void setMicros(unsigned long time) { now = time; }
+
+unsigned long millis() { return now / 1000; }
+unsigned long micros() { return now; }
+void delay(unsigned long ms) { now += ms * 1000; }
+void delayMicroseconds(unsigned int us) { now += us; }
+int digitalRead(uint8_t pin) { now += 1; return levelAt(now); }
+void pinMode(uint8_t pin, uint8_t mode) {}
+void yield() {}
@@ -0,0 +1,58 @@
+//
+//   Host stand in for the Arduino core, just enough to build SDL_ESP32_WeatherRack2.cpp on a PC.
+//   Time is virtual: it moves on with delay(), delayMicroseconds() and each digitalRead(),
+//   and the pin follows the waveform the test loads with setWaveform()
+//
+
+#ifndef ARDUINO_STUB_H
+#define ARDUINO_STUB_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef uint16_t word;
+typedef bool boolean;
+
+#define INPUT 0
+#define OUTPUT 1
+#define LOW 0
+#define HIGH 1
+#define B00000111 0x07
+#define B01110000 0x70
+#define B1000000 0x40
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+int digitalRead(uint8_t pin);
+void pinMode(uint8_t pin, uint8_t mode);
+void yield();
+
+void setMicros(unsigned long time);
+
+// level changes (time in us, new level), sorted by time
+void setWaveform(const unsigned long *times, const uint8_t *levels, int count);
+int levelAt(unsigned long time);
+
+class Print {
+  public:
+    virtual size_t write(uint8_t c) { return fputc(c, stdout) == EOF ? 0 : 1; }
+    virtual size_t write(const uint8_t *buffer, size_t size) { size_t n = 0; while (size--) n += write(*buffer++); return n; }
+    size_t print(const char *s) { size_t n = 0; while (*s) n += write(*s++); return n; }
+    size_t println(const char *s) { return print(s) + print("\n"); }
+};
+
+// Nothing to read unless a test overrides it
+class Stream : public Print {
+  public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+};
+
+#endif
@@ -0,0 +1 @@
+// Host stand in, SDL_ESP32_WeatherRack2.cpp includes SPI.h but does not use it
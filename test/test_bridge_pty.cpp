@@ -0,0 +1,234 @@
+//
+//   Host test: the serial bridge end to end.
+//
+//   Decodes two F016TH copies and an FT020T from a synthetic waveform, sends each reading and
+//   its raw frame with WeatherRack2Bridge into one side of a pty, and runs wr2bridged on the
+//   other side.  Then one counters message is lost on the wire, one gets through, and a new
+//   bridge (a reset ESP32) starts again from sequence 0.  Fails unless the JSON lines on
+//   wr2bridged's socket show the readings, the raw frames, the counters with the lost message
+//   and the restart.
+//
+//   Run with make in this directory (wr2bridged is built next to it)
+//
+
+#include "Arduino.h"
+#include "SDL_ESP32_WeatherRack2.h"
+#include "SDL_ESP32_WeatherRack2_Bridge.h"
+#include "waveform.h"
+
+#include <pty.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define WAVEFORM_END 900000UL
+
+// The ESP32's serial port: writes go to the pty master, or nowhere while dropping
+class PtyStream : public Stream
+{
+  public:
+    PtyStream(int fd) : fd(fd), dropping(false) {}
+
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size)
+    {
+      if (dropping)
+        return size;
+      return ::write(fd, buffer, size) == (ssize_t)size ? size : 0;
+    }
+
+    int fd;
+    bool dropping;
+};
+
+SDL_ESP32_WeatherRack2 weatherRack2;
+WeatherRack2Bridge *bridge = NULL;
+
+void received(const WeatherRack2Reading &reading)
+{
+  bridge->sendReading(reading);
+  bridge->sendRawFrame(weatherRack2);
+}
+
+// Connects to wr2bridged's socket, waiting up to a second for it to appear
+static int connectSocket(const char *path)
+{
+  struct sockaddr_un address;
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+  for (int i = 0; i < 100; i++)
+  {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0)
+      return fd;
+    close(fd);
+    usleep(10000);
+  }
+  return -1;
+}
+
+// Everything wr2bridged sends until it has been quiet for half a second
+static int readLines(int fd, char *buffer, int size)
+{
+  int length = 0;
+  struct pollfd fds;
+
+  fds.fd = fd;
+  fds.events = POLLIN;
+  while ((length < size - 1) && (poll(&fds, 1, 500) > 0))
+  {
+    ssize_t n = read(fd, buffer + length, size - 1 - length);
+
+    if (n <= 0)
+      break;
+    length += n;
+  }
+  buffer[length] = 0;
+  return length;
+}
+
+// The line containing every one of the fragments, or NULL
+static const char *findLine(const char *lines, const char *first, const char *second)
+{
+  const char *line = lines;
+
+  while (*line)
+  {
+    const char *end = strchr(line, '\n');
+    int length = end ? end - line : strlen(line);
+    char copy[1024];
+
+    snprintf(copy, sizeof(copy), "%.*s", length, line);
+    if (strstr(copy, first) && ((second == NULL) || strstr(copy, second)))
+      return line;
+    line += length + (end ? 1 : 0);
+  }
+  return NULL;
+}
+
+static int failures = 0;
+
+static void check(const char *lines, const char *what, const char *first, const char *second)
+{
+  bool found = (findLine(lines, first, second) != NULL);
+
+  printf("%s: %s\n", what, found ? "ok" : "MISSING");
+  if (!found)
+    failures++;
+}
+
+int main(int argc, char **argv)
+{
+  const char *daemon = (argc > 1) ? argv[1] : "./wr2bridged";
+  char directory[] = "/tmp/wr2bridge.XXXXXX";
+  char socketPath[64];
+  char ptyName[64];
+  int master;
+  int slave;
+
+  if ((mkdtemp(directory) == NULL) || (openpty(&master, &slave, ptyName, NULL, NULL) < 0))
+  {
+    perror("setup");
+    return 1;
+  }
+  snprintf(socketPath, sizeof(socketPath), "%s/wr2bridged.sock", directory);
+
+  struct termios settings;
+  tcgetattr(slave, &settings);
+  cfmakeraw(&settings);
+  tcsetattr(slave, TCSANOW, &settings);
+
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    execl(daemon, "wr2bridged", "-s", socketPath, ptyName, (char *)NULL);
+    perror(daemon);
+    _exit(1);
+  }
+
+  int client = connectSocket(socketPath);
+  if (client < 0)
+  {
+    printf("FAIL: cannot connect to %s\n", socketPath);
+    kill(pid, SIGTERM);
+    return 1;
+  }
+
+  PtyStream port(master);
+  WeatherRack2Bridge firstBridge(port);
+
+  // boot messages before the first bridge message
+  port.print("SwitchDoc Labs WeatherRack2\r\n");
+
+  waveformClear();
+  waveformNoise(200000);
+  waveformF016TH(0x4F, 1, 1099, 11);
+  waveformNoise(290000);
+  waveformF016TH(0x4F, 1, 1099, 11);
+  waveformNoise(500000);
+  waveformFT020T(0x5A, 1150, 55);
+  waveformNoise(WAVEFORM_END);
+  waveformLoad();
+
+  bridge = &firstBridge;
+  weatherRack2.begin();
+  weatherRack2.subscribe(received);
+
+#ifdef WEATHERRACK2_OVERSAMPLE
+  double sampleTime = 0;
+
+  while (sampleTime < WAVEFORM_END)
+  {
+    uint32_t samples = waveformSamples(sampleTime, WEATHERRACK2_SAMPLE_PERIOD);
+
+    weatherRack2.feedSamples(&samples, 1);
+    weatherRack2.poll();
+  }
+#else
+  while (micros() < WAVEFORM_END)
+    weatherRack2.poll();
+#endif
+
+  // lost on the wire, then one that gets through
+  port.dropping = true;
+  firstBridge.sendCounters(weatherRack2);
+  port.dropping = false;
+  firstBridge.sendCounters(weatherRack2);
+
+  // the ESP32 resets
+  WeatherRack2Bridge secondBridge(port);
+  bridge = &secondBridge;
+  secondBridge.sendCounters(weatherRack2);
+
+  static char lines[8192];
+  readLines(client, lines, sizeof(lines));
+  printf("%s", lines);
+
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  unlink(socketPath);
+  rmdir(directory);
+
+  check(lines, "F016TH reading", "\"type\":\"reading\",\"seq\":0,", "\"device\":79,\"modelnumber\":5,\"channel\":1,\"battery\":\"OK\",\"temperature\":21.06,\"humidity\":11");
+  check(lines, "F016TH raw frame", "\"type\":\"raw\",\"seq\":1,", NULL);
+  check(lines, "FT020T reading", "\"type\":\"reading\"", "\"device\":90,\"modelnumber\":12,");
+  check(lines, "counters after a lost message", "\"type\":\"counters\"", "\"bridgebad\":1,\"bridgelost\":1}");
+  check(lines, "restart", "\"type\":\"restart\",\"seq\":0,", NULL);
+  check(lines, "counters after the restart", "\"type\":\"counters\",\"seq\":0,", NULL);
+
+  if (failures != 0)
+  {
+    printf("FAIL\n");
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
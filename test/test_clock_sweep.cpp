@@ -0,0 +1,121 @@
+//
+//   Host test: clock error and jitter tolerance of the decoder.
+//
+//   Plays two F016TH copies and an FT020T with the sensor's bit period swept either side of
+//   nominal, with and without transition jitter, each at 8 sampling phases, and fails unless all
+//   three frames decode with the right values every time.  Build with WEATHERRACK2_OVERSAMPLE to
+//   sweep the oversampled decoder.
+//
+//   Run with make in this directory
+//
+
+#include "Arduino.h"
+#include "SDL_ESP32_WeatherRack2.h"
+#include "waveform.h"
+
+#define WAVEFORM_END 900000UL
+#define PHASES 8
+
+struct SweepCase
+{
+  int bitPeriod;
+  int jitter;
+};
+
+// -3% to +3% of 976us (8 samples of WEATHERRACK2_SAMPLE_PERIOD), without jitter and with 90us
+static const SweepCase sweep[] =
+{
+  { 946, 0 }, { 956, 0 }, { 966, 0 }, { 976, 0 }, { 986, 0 }, { 996, 0 }, { 1005, 0 },
+  { 946, 90 }, { 956, 90 }, { 966, 90 }, { 976, 90 }, { 986, 90 }, { 996, 90 }, { 1005, 90 }
+};
+
+SDL_ESP32_WeatherRack2 weatherRack2;
+
+static int indoorReadings;
+static int weatherRack2Readings;
+static int wrongValues;
+
+void received(const WeatherRack2Reading &reading)
+{
+  if (reading.modelnumber == WR2_MODEL_F016TH)
+  {
+    indoorReadings++;
+    if ((reading.device != 0x4F) || (reading.channel != 1) || (reading.humidity != 11) || (fabs(reading.temperature - 21.06) > 0.01))
+      wrongValues++;
+  }
+  else if (reading.modelnumber == WR2_MODEL_FT020T)
+  {
+    weatherRack2Readings++;
+    if ((reading.device != 0x5A) || (reading.humidity != 55) || (fabs(reading.temperature - 23.89) > 0.01))
+      wrongValues++;
+  }
+}
+
+// True if all three frames decode with the waveform started phase us late
+static bool decodes(const SweepCase &sweepCase, unsigned long phase, unsigned long seed)
+{
+  waveformClear();
+  waveformBitPeriod(sweepCase.bitPeriod);
+  waveformJitter(sweepCase.jitter, seed);
+  waveformNoise(200000 + phase);
+  waveformF016TH(0x4F, 1, 1099, 11);
+  waveformNoise(290000 + phase);
+  waveformF016TH(0x4F, 1, 1099, 11);
+  waveformNoise(500000 + phase);
+  waveformFT020T(0x5A, 1150, 55);
+  waveformNoise(WAVEFORM_END);
+  waveformLoad();
+
+  setMicros(0);
+  indoorReadings = 0;
+  weatherRack2Readings = 0;
+  wrongValues = 0;
+  weatherRack2.begin();
+
+#ifdef WEATHERRACK2_OVERSAMPLE
+  double sampleTime = 0;
+
+  while (sampleTime < WAVEFORM_END)
+  {
+    uint32_t samples = waveformSamples(sampleTime, WEATHERRACK2_SAMPLE_PERIOD);
+
+    weatherRack2.feedSamples(&samples, 1);
+    weatherRack2.poll();
+  }
+#else
+  while (micros() < WAVEFORM_END)
+    weatherRack2.poll();
+#endif
+
+  return (indoorReadings == 2) && (weatherRack2Readings == 1) && (wrongValues == 0);
+}
+
+int main()
+{
+  int failures = 0;
+
+  weatherRack2.subscribe(received);
+
+  for (unsigned int i = 0; i < sizeof(sweep) / sizeof(sweep[0]); i++)
+  {
+    int passed = 0;
+
+    for (int phase = 0; phase < PHASES; phase++)
+    {
+      if (decodes(sweep[i], phase * WEATHERRACK2_SAMPLE_PERIOD / PHASES, i * PHASES + phase + 1))
+        passed++;
+    }
+
+    printf("bit period %4dus (%+.1f%%) jitter +-%3dus: %d/%d\n", sweep[i].bitPeriod, 100.0 * (sweep[i].bitPeriod - 976) / 976, sweep[i].jitter, passed, PHASES);
+    if (passed != PHASES)
+      failures++;
+  }
+
+  if (failures != 0)
+  {
+    printf("FAIL\n");
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,295 @@
+//
+//   Host test: WeatherRack2History against a brute force reference.
+//
+//   Records a week of noisy one minute readings from 8 F016TH channels and an FT020T, keeping
+//   every value in plain arrays as well, then checks query() against a scan of those arrays for
+//   random time ranges and filters - once with a pool big enough for the week, and once with a
+//   small pool that has had to overwrite the oldest blocks.  Also checks the week fits in the
+//   size the README gives.
+//
+//   Run with make in this directory
+//
+
+#include "Arduino.h"
+#include "SDL_ESP32_WeatherRack2_History.h"
+
+#define MINUTES (7 * 24 * 60)
+#define CHANNELS 8
+#define WR2_DEVICE 90
+#define SERIES (2 * CHANNELS + WR2_FIELD_COUNT)
+#define WEEK_BYTES_LIMIT 580000UL    // "570KB for the week test_history ... records" in the README
+#define SMALL_POOL 60000UL
+#define QUERIES 3000
+
+// One series of the reference: which sensor and field, and its value at every minute
+struct ReferenceSeries {
+  uint8_t modelnumber;
+  uint8_t device;
+  uint8_t channel;
+  uint8_t field;
+  int32_t values[MINUTES];
+};
+
+static uint32_t times[MINUTES];
+static ReferenceSeries reference[SERIES];
+
+static unsigned long seed = 1;
+
+static long nextRandom(long limit)
+{
+  seed = seed * 1103515245UL + 12345UL;
+  return ((seed >> 8) & 0xFFFFFF) % limit;
+}
+
+static void setSeries(int s, uint8_t modelnumber, uint8_t device, uint8_t channel, uint8_t field)
+{
+  reference[s].modelnumber = modelnumber;
+  reference[s].device = device;
+  reference[s].channel = channel;
+  reference[s].field = field;
+}
+
+// Series numbers: temperature of channel 1-8, humidity of channel 1-8, then the FT020T fields
+static int indoorSeries(int channel, uint8_t field)
+{
+  return (field == WR2_FIELD_TEMPERATURE ? 0 : CHANNELS) + channel - 1;
+}
+
+static int weatherRack2Series(uint8_t field)
+{
+  return 2 * CHANNELS + field;
+}
+
+// A week of readings: a daily cycle with a few hundredths of noise on the temperatures, humidity
+// wandering by a percent, wind and direction all over the place, and a minute or so between
+// readings give or take a couple of seconds
+static void makeWeek()
+{
+  uint32_t time = 1600000000UL;
+  int32_t humidity[CHANNELS];
+  int32_t rain = 1000;
+
+  for (int channel = 1; channel <= CHANNELS; channel++)
+  {
+    setSeries(indoorSeries(channel, WR2_FIELD_TEMPERATURE), WR2_MODEL_F016TH, channel * 3, channel, WR2_FIELD_TEMPERATURE);
+    setSeries(indoorSeries(channel, WR2_FIELD_HUMIDITY), WR2_MODEL_F016TH, channel * 3, channel, WR2_FIELD_HUMIDITY);
+    humidity[channel - 1] = 40 + channel;
+  }
+  for (int field = 0; field < WR2_FIELD_COUNT; field++)
+    setSeries(weatherRack2Series(field), WR2_MODEL_FT020T, WR2_DEVICE, 0, field);
+
+  for (int m = 0; m < MINUTES; m++)
+  {
+    double day = sin(m * 2 * M_PI / 1440);
+
+    time += 58 + nextRandom(5);
+    times[m] = time;
+
+    for (int channel = 1; channel <= CHANNELS; channel++)
+    {
+      if (nextRandom(20) == 0)
+        humidity[channel - 1] += nextRandom(3) - 1;
+      reference[indoorSeries(channel, WR2_FIELD_TEMPERATURE)].values[m] = 2000 + channel * 50 + (int32_t)(300 * day) + nextRandom(7) - 3;
+      reference[indoorSeries(channel, WR2_FIELD_HUMIDITY)].values[m] = humidity[channel - 1];
+    }
+
+    if (nextRandom(30) == 0)
+      rain += nextRandom(4);
+    reference[weatherRack2Series(WR2_FIELD_TEMPERATURE)].values[m] = 1000 + (int32_t)(800 * day) + nextRandom(11) - 5;
+    reference[weatherRack2Series(WR2_FIELD_HUMIDITY)].values[m] = 60 - (int32_t)(20 * day) + nextRandom(3);
+    reference[weatherRack2Series(WR2_FIELD_AVEWINDSPEED)].values[m] = nextRandom(30);
+    reference[weatherRack2Series(WR2_FIELD_GUSTWINDSPEED)].values[m] = nextRandom(60);
+    reference[weatherRack2Series(WR2_FIELD_WINDDIRECTION)].values[m] = nextRandom(360);
+    reference[weatherRack2Series(WR2_FIELD_CUMULATIVERAIN)].values[m] = rain;
+    reference[weatherRack2Series(WR2_FIELD_LIGHT)].values[m] = (day > 0) ? (int32_t)(40000 * day) + nextRandom(500) : 0;
+    reference[weatherRack2Series(WR2_FIELD_UV)].values[m] = (day > 0) ? (int32_t)(9 * day) : 0;
+  }
+}
+
+static void recordWeek(WeatherRack2History &history)
+{
+  for (int m = 0; m < MINUTES; m++)
+  {
+    for (int channel = 1; channel <= CHANNELS; channel++)
+    {
+      WeatherRack2Reading reading;
+
+      memset(&reading, 0, sizeof(reading));
+      reading.modelnumber = WR2_MODEL_F016TH;
+      reading.device = channel * 3;
+      reading.channel = channel;
+      reading.temperature = reference[indoorSeries(channel, WR2_FIELD_TEMPERATURE)].values[m] / 100.0;
+      reading.humidity = reference[indoorSeries(channel, WR2_FIELD_HUMIDITY)].values[m];
+      history.record(reading, times[m]);
+    }
+
+    WeatherRack2Reading reading;
+
+    memset(&reading, 0, sizeof(reading));
+    reading.modelnumber = WR2_MODEL_FT020T;
+    reading.device = WR2_DEVICE;
+    reading.temperature = reference[weatherRack2Series(WR2_FIELD_TEMPERATURE)].values[m] / 100.0;
+    reading.humidity = reference[weatherRack2Series(WR2_FIELD_HUMIDITY)].values[m];
+    reading.avewindspeed = reference[weatherRack2Series(WR2_FIELD_AVEWINDSPEED)].values[m];
+    reading.gustwindspeed = reference[weatherRack2Series(WR2_FIELD_GUSTWINDSPEED)].values[m];
+    reading.winddirection = reference[weatherRack2Series(WR2_FIELD_WINDDIRECTION)].values[m];
+    reading.cumulativerain = reference[weatherRack2Series(WR2_FIELD_CUMULATIVERAIN)].values[m];
+    reading.light = reference[weatherRack2Series(WR2_FIELD_LIGHT)].values[m];
+    reading.uv = reference[weatherRack2Series(WR2_FIELD_UV)].values[m];
+    history.record(reading, times[m]);
+  }
+}
+
+static boolean matches(const ReferenceSeries &series, uint8_t field, uint8_t modelnumber, int device, uint8_t channel)
+{
+  return (series.field == field) &&
+         ((modelnumber == WR2_MODEL_ANY) || (modelnumber == series.modelnumber)) &&
+         ((device == WR2_DEVICE_ANY) || (device == series.device)) &&
+         ((channel == WR2_CHANNEL_ANY) || (channel == series.channel));
+}
+
+// Checks query() against a scan of the minutes each series still holds (kept[s] on)
+static int checkQueries(WeatherRack2History &history, const int *kept, const char *name)
+{
+  int failures = 0;
+
+  for (int q = 0; q < QUERIES; q++)
+  {
+    // ranges from a few minutes to the whole week, some starting or ending outside it
+    uint32_t from = times[0] - 600 + nextRandom(MINUTES * 60 + 1200);
+    uint32_t to = from + ((nextRandom(4) == 0) ? nextRandom(600) : nextRandom(MINUTES * 60));
+    int s = nextRandom(SERIES);
+    uint8_t field = reference[s].field;
+    uint8_t modelnumber = reference[s].modelnumber;
+    int device = reference[s].device;
+    uint8_t channel = reference[s].channel;
+    boolean single = true;
+
+    // half the queries are across several series
+    switch (nextRandom(6))
+    {
+      case 0: device = WR2_DEVICE_ANY; channel = WR2_CHANNEL_ANY; single = false; break;
+      case 1: modelnumber = WR2_MODEL_ANY; device = WR2_DEVICE_ANY; channel = WR2_CHANNEL_ANY; single = false; break;
+      case 2: channel = WR2_CHANNEL_ANY; break;
+    }
+
+    uint32_t count = 0;
+    int32_t min = INT32_MAX;
+    int32_t max = INT32_MIN;
+    int64_t sum = 0;
+    int32_t last = 0;
+    uint32_t lastTime = 0;
+
+    for (int r = 0; r < SERIES; r++)
+    {
+      if (!matches(reference[r], field, modelnumber, device, channel))
+        continue;
+      for (int m = kept[r]; m < MINUTES; m++)
+      {
+        if ((times[m] < from) || (times[m] > to))
+          continue;
+        int32_t value = reference[r].values[m];
+        count++;
+        sum += value;
+        if (value < min)
+          min = value;
+        if (value > max)
+          max = value;
+        if (times[m] >= lastTime)
+        {
+          last = value;
+          lastTime = times[m];
+        }
+      }
+    }
+
+    WeatherRack2HistoryStats stats;
+    boolean found = history.query(field, from, to, stats, modelnumber, device, channel);
+    boolean good;
+
+    if (count == 0)
+      good = !found;
+    else
+      good = found && (stats.count == count) && (stats.min == min) && (stats.max == max) &&
+             (fabs(stats.mean - (double)sum / count) <= 0.01 + fabs(stats.mean) * 1e-5) &&
+             (stats.lastTime == lastTime) && (!single || (stats.last == last));
+
+    if (!good)
+    {
+      if (failures < 5)
+        printf("%s: query(%d, %u, %u, %d, %d, %d) count %u min %d max %d mean %.2f last %d at %u, expected %u %d %d %.2f %d at %u\n",
+               name, field, from, to, modelnumber, device, channel, stats.count, stats.min, stats.max, stats.mean,
+               stats.last, stats.lastTime, count, min, max, count ? (double)sum / count : 0.0, last, lastTime);
+      failures++;
+    }
+  }
+
+  printf("%s: %d/%d queries match\n", name, QUERIES - failures, QUERIES);
+  return failures;
+}
+
+// Which minute each series still starts from, from how many samples the store holds for it
+static void findKept(WeatherRack2History &history, int *kept)
+{
+  for (int s = 0; s < SERIES; s++)
+  {
+    WeatherRack2HistoryStats stats;
+
+    history.query(reference[s].field, 0, 0xFFFFFFFFUL, stats, reference[s].modelnumber, reference[s].device, reference[s].channel);
+    kept[s] = MINUTES - stats.count;
+  }
+}
+
+int main()
+{
+  int failures = 0;
+  int kept[SERIES];
+
+  makeWeek();
+
+  WeatherRack2History week;
+  week.begin(1000000);
+  recordWeek(week);
+  findKept(week, kept);
+
+  printf("week: %u samples in %u blocks, %u bytes (%.2f bytes a sample)\n", week.readSamples(), week.readBlocks(),
+         week.readBytesUsed(), (double)week.readBytesUsed() / week.readSamples());
+  for (int s = 0; s < SERIES; s++)
+  {
+    if (kept[s] != 0)
+    {
+      printf("FAIL: series %d lost %d samples with room to spare\n", s, kept[s]);
+      failures++;
+    }
+  }
+  if (week.readBytesUsed() > WEEK_BYTES_LIMIT)
+  {
+    printf("FAIL: a week takes more than the %lu bytes the README says\n", WEEK_BYTES_LIMIT);
+    failures++;
+  }
+  failures += checkQueries(week, kept, "week");
+
+  WeatherRack2History small;
+  small.begin(SMALL_POOL);
+  recordWeek(small);
+  findKept(small, kept);
+
+  uint32_t held = 0;
+  for (int s = 0; s < SERIES; s++)
+    held += MINUTES - kept[s];
+  printf("small pool: %u of %u samples kept\n", small.readSamples(), MINUTES * SERIES);
+  if ((held != small.readSamples()) || (held >= (uint32_t)MINUTES * SERIES))
+  {
+    printf("FAIL: the small pool should have overwritten its oldest blocks (%u held, %u counted)\n", held, small.readSamples());
+    failures++;
+  }
+  failures += checkQueries(small, kept, "small pool");
+
+  if (failures != 0)
+  {
+    printf("FAIL\n");
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
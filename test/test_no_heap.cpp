@@ -0,0 +1,199 @@
+//
+//   Host test: with WEATHERRACK2_NO_STRING the receiver must not touch the heap.
+//
+//   Builds the library against the Arduino stub in stub/, plays a recorded-style waveform
+//   (noise, two F016TH copies, noise, an FT020T, noise) into the pin and counts every call to
+//   malloc/calloc/realloc and operator new made from begin() to the last poll().  Each message
+//   must also arrive once, with the temperature, humidity and device it was sent with.
+//   With WEATHERRACK2_OVERSAMPLE the same waveform is sampled and handed over with feedSamples().
+//
+//   Run with make in this directory
+//
+
+#include "Arduino.h"
+#include "SDL_ESP32_WeatherRack2.h"
+#include "waveform.h"
+
+#include <new>
+
+#ifndef WEATHERRACK2_NO_STRING
+#error "test_no_heap needs WEATHERRACK2_NO_STRING"
+#endif
+
+// Counting allocator
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static bool counting = false;
+static unsigned long allocations = 0;
+
+extern "C" void *malloc(size_t size)
+{
+  if (counting)
+    allocations++;
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+  if (counting)
+    allocations++;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+  if (counting)
+    allocations++;
+  return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr)
+{
+  __libc_free(ptr);
+}
+
+void *operator new(size_t size)
+{
+  void *ptr = malloc(size);
+  if (ptr == NULL)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void *operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+  free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+  free(ptr);
+}
+
+void operator delete(void *ptr, size_t size) noexcept
+{
+  free(ptr);
+}
+
+void operator delete[](void *ptr, size_t size) noexcept
+{
+  free(ptr);
+}
+
+// Receiver
+
+SDL_ESP32_WeatherRack2 weatherRack2;
+
+#define WAVEFORM_END 1500000UL
+
+static int indoorReadings = 0;
+static int weatherRack2Readings = 0;
+static int wrongValues = 0;
+static int jsonFailures = 0;
+
+void received(const WeatherRack2Reading &reading)
+{
+  char json[WEATHERRACK2_JSON_SIZE];
+
+  if (weatherRack2.toJSON(reading, json, sizeof(json)) <= 0)
+    jsonFailures++;
+
+  if (reading.modelnumber == WR2_MODEL_F016TH)
+  {
+    indoorReadings++;
+    if ((reading.device != 0x4F) || (reading.channel != 1) || (reading.humidity != 11) || (fabs(reading.temperature - 21.06) > 0.01))
+      wrongValues++;
+  }
+  else if (reading.modelnumber == WR2_MODEL_FT020T)
+  {
+    weatherRack2Readings++;
+    if ((reading.device != 0x5A) || (reading.humidity != 55) || (fabs(reading.temperature - 23.89) > 0.01))
+      wrongValues++;
+  }
+}
+
+#ifdef WEATHERRACK2_OVERSAMPLE
+
+static double sampleTime = 0;
+
+// Samples the waveform up to time, 32 samples to a word, into the receiver
+static void feedUntil(unsigned long time)
+{
+  while (sampleTime < time)
+  {
+    uint32_t samples = waveformSamples(sampleTime, WEATHERRACK2_SAMPLE_PERIOD);
+
+    weatherRack2.feedSamples(&samples, 1);
+  }
+}
+
+#endif
+
+int main()
+{
+  waveformClear();
+  waveformNoise(200000);
+  waveformF016TH(0x4F, 1, 1099, 11);
+  waveformNoise(280000);
+  waveformF016TH(0x4F, 1, 1099, 11);
+  waveformNoise(600000);
+  waveformFT020T(0x5A, 1150, 55);
+  waveformNoise(WAVEFORM_END);
+  waveformLoad();
+
+  counting = true;
+
+  weatherRack2.begin();
+
+#ifdef WEATHERRACK2_OVERSAMPLE
+  // the first F016TH is already buffered when waitForNextJSON() runs
+  feedUntil(300000);
+#endif
+  const char *json = weatherRack2.waitForNextJSON();
+  bool firstFound = (strstr(json, "F016TH") != NULL) && (strstr(json, "\"device\" : \"79\"") != NULL) &&
+                    (strstr(json, "\"temperature\" : \"21.06\", \"humidity\" : \"11\"") != NULL);
+
+  weatherRack2.subscribe(received);
+  while (millis() < WAVEFORM_END / 1000)
+  {
+#ifdef WEATHERRACK2_OVERSAMPLE
+    // what the sample timer would have written while loop() was busy
+    feedUntil(millis() * 1000UL + 30000UL);
+    delay(30);
+#endif
+    weatherRack2.poll();
+  }
+
+  counting = false;
+
+  printf("waitForNextJSON: %s\n", json);
+  printf("callbacks: %d F016TH, %d FT020T, allocations: %lu\n", indoorReadings, weatherRack2Readings, allocations);
+
+  // the first F016TH copy went to waitForNextJSON(), the second to the callback
+  if (!firstFound || (indoorReadings != 1) || (weatherRack2Readings != 1) || (jsonFailures != 0))
+  {
+    printf("FAIL: messages not decoded\n");
+    return 1;
+  }
+  if (wrongValues != 0)
+  {
+    printf("FAIL: %d readings decoded with the wrong temperature, humidity or device\n", wrongValues);
+    return 1;
+  }
+  if (allocations != 0)
+  {
+    printf("FAIL: %lu heap allocations after begin()\n", allocations);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
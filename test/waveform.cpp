@@ -0,0 +1,184 @@
+#include "waveform.h"
+
+#define MAX_EDGES 40000
+
+static unsigned long edgeTimes[MAX_EDGES];
+static uint8_t edgeLevels[MAX_EDGES];
+static int edges = 0;
+static unsigned long waveTime = 0;
+static int bitPeriod = WAVEFORM_BIT_PERIOD;
+static int jitterLimit = 0;
+static unsigned long jitterSeed = 1;
+static unsigned long noiseSeed = 1;
+
+static unsigned long nextRandom(unsigned long &seed)
+{
+  seed = seed * 1103515245UL + 12345UL;
+  return (seed >> 8) & 0xFFFFFF;
+}
+
+void waveformClear()
+{
+  edges = 0;
+  waveTime = 0;
+  noiseSeed = 1;
+}
+
+void waveformBitPeriod(int period)
+{
+  bitPeriod = period;
+}
+
+void waveformJitter(int jitter, unsigned long seed)
+{
+  jitterLimit = jitter;
+  jitterSeed = seed;
+}
+
+static void addEdge(unsigned long time, uint8_t level)
+{
+  // jitter must not reorder the edges, levelAt() needs them sorted
+  if ((edges > 0) && (time < edgeTimes[edges - 1]))
+    time = edgeTimes[edges - 1];
+
+  if (edges < MAX_EDGES)
+  {
+    edgeTimes[edges] = time;
+    edgeLevels[edges] = level;
+    edges++;
+  }
+}
+
+static void addJitteredEdge(unsigned long time, uint8_t level)
+{
+  long offset = 0;
+
+  if (jitterLimit > 0)
+    offset = (long)(nextRandom(jitterSeed) % (2 * jitterLimit + 1)) - jitterLimit;
+  addEdge(time + offset, level);
+}
+
+static void addBit(int bit)
+{
+  addJitteredEdge(waveTime, bit ? 1 : 0);
+  addJitteredEdge(waveTime + bitPeriod / 2, bit ? 0 : 1);
+  waveTime += bitPeriod;
+}
+
+// bytes[0] is the 0xFD preamble, sent as the header pattern
+static void addFrame(const uint8_t *bytes, int length)
+{
+  addBit(0);
+  for (int i = 0; i < 14; i++)
+    addBit(1);
+  addBit(0);
+  addBit(1);
+
+  for (int i = 1; i < length; i++)
+    for (int bit = 7; bit >= 0; bit--)
+      addBit((bytes[i] >> bit) & 1);
+
+  for (int i = 0; i < 8; i++)
+    addBit(0);
+  addEdge(waveTime, 0);
+}
+
+void waveformNoise(unsigned long until)
+{
+  while (waveTime < until)
+  {
+    unsigned long random = nextRandom(noiseSeed);
+
+    addEdge(waveTime, random & 1);
+    waveTime += 50 + (random >> 1) % 400;
+  }
+  waveTime = until;
+  addEdge(waveTime, 0);
+}
+
+// Same LFSR checksum as SDL_ESP32_WeatherRack2::Checksum()
+static uint8_t checksum(int length, const uint8_t *buff)
+{
+  uint8_t mask = 0x7C;
+  uint8_t sum = 0x64;
+
+  for (int i = 0; i < length; i++)
+  {
+    uint8_t data = buff[i];
+    for (int bit = 7; bit >= 0; bit--)
+    {
+      uint8_t carry = mask & 1;
+      mask = (mask >> 1) | (mask << 7);
+      if (carry)
+        mask ^= 0x18;
+      if (data & 0x80)
+        sum ^= mask;
+      data <<= 1;
+    }
+  }
+  return sum;
+}
+
+static uint8_t crc8(uint8_t crc, const uint8_t *buff, int length)
+{
+  while (length--)
+  {
+    crc ^= *buff++;
+    for (int i = 0; i < 8; i++)
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+void waveformF016TH(uint8_t device, int channel, int rawTemperature, int humidity)
+{
+  uint8_t frame[7] = { 0xFD, 0x45, device, (uint8_t)(((channel - 1) << 4) | ((rawTemperature >> 8) & 7)), (uint8_t)(rawTemperature & 0xff), (uint8_t)humidity, 0 };
+
+  frame[6] = checksum(5, &frame[1]);
+  addFrame(frame, 7);
+}
+
+void waveformFT020T(uint8_t serialLow, int temperature, int humidity)
+{
+  uint8_t data[14] = { 0 };
+  uint8_t frame[16];
+
+  data[0] = 0xC0 | (serialLow >> 4);
+  data[1] = serialLow << 4;
+  data[2] = 3;
+  data[3] = 7;
+  data[4] = 200;
+  data[5] = 0x01;
+  data[6] = 0x20;
+  data[7] = (temperature >> 8) & 0xf;
+  data[8] = temperature & 0xff;
+  data[9] = humidity;
+  data[10] = 0x10;
+  data[11] = 0x20;
+  data[12] = 5;
+  data[13] = crc8(0xc0, data, 13);
+
+  // on air the payload is a nibble later than the CRC'd bytes
+  frame[0] = 0xFD;
+  frame[1] = 0x40 | (data[0] >> 4);
+  for (int i = 2; i < 16; i++)
+    frame[i] = ((data[i - 2] & 0xf) << 4) | (i - 1 < 14 ? data[i - 1] >> 4 : 0);
+  addFrame(frame, 16);
+}
+
+void waveformLoad()
+{
+  setWaveform(edgeTimes, edgeLevels, edges);
+}
+
+uint32_t waveformSamples(double &time, double period)
+{
+  uint32_t samples = 0;
+
+  for (int bit = 0; bit < 32; bit++)
+  {
+    samples |= (uint32_t)levelAt((unsigned long)time) << bit;
+    time += period;
+  }
+  return samples;
+}
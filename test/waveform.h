@@ -0,0 +1,25 @@
+//
+//   Synthetic 433MHz receiver output for the host tests: Manchester coded F016TH and FT020T
+//   frames (polarity 1, a 1 is high then low) with random noise between them, played into
+//   digitalRead() by the Arduino stub
+//
+
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include "Arduino.h"
+
+#define WAVEFORM_BIT_PERIOD 980     // us, a nominal sensor
+
+void waveformClear();
+void waveformBitPeriod(int period);
+void waveformJitter(int jitter, unsigned long seed);   // each transition moved up to +-jitter us
+void waveformNoise(unsigned long until);
+void waveformF016TH(uint8_t device, int channel, int rawTemperature, int humidity);
+void waveformFT020T(uint8_t serialLow, int temperature, int humidity);
+void waveformLoad();                                  // hands the waveform to the stub's digitalRead()
+
+// 32 samples taken period us apart from time on, the first in bit 0
+uint32_t waveformSamples(double &time, double period);
+
+#endif